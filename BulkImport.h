@@ -0,0 +1,90 @@
+//
+//  BulkImport.h
+//  QC Utilities
+//
+//  Created by Randall Maas on 10/19/26.
+/*
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+ 
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+ 
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+
+#import "QCUtils.h"
+
+/** A Quartz Plugin to import many strings at once, from the files in a folder or a list of paths and URLs */
+@interface BulkImport : QCPlugIn
+{
+    // The state is 0: starting, 1: loading, 2: results changed, 3: results passed along, 4: done
+    int volatile state;
+    // Changes each time the inputs change, so that loads for the old inputs are ignored
+    int volatile generation;
+    // The loaded strings; the key is the path
+    NSMutableDictionary* strings;
+    // The error messages, if any; the key is the path
+    NSMutableDictionary* errors;
+    // The number of paths being loaded
+    NSUInteger total;
+    // The number of paths loaded (or failed) so far
+    NSUInteger volatile completed;
+
+    // The queue that the loads are started from, and that the rest of these are used on
+    dispatch_queue_t scheduler;
+    // The paths waiting to be loaded
+    NSMutableArray* waiting;
+    // The queues that loads can be started on; each runs one load at a time
+    NSMutableArray* freeLanes;
+    // The host of each path that is an HTTP URL
+    NSDictionary* pathHosts;
+    // The number of loads in flight to each host
+    NSMutableDictionary* hostLoads;
+}
+
+/* Declare a property input port of type "String" and with the key "inputPattern"
+ This is a file path pattern, with * and ? wildcards, for the files to load.
+ */
+@property(assign) NSString* inputPattern;
+
+/* Declare a property input port of type "Structure" and with the key "inputPaths"
+ This is a list of file paths or URLs to load.
+ */
+@property(assign) NSDictionary* inputPaths;
+
+/* Declare a property input port of type "Index" and with the key "inputMaxLoads"
+ This is the most files or URLs to load at the same time.
+ */
+@property(assign) NSUInteger inputMaxLoads;
+
+/* Declare a property output port of type "Structure" and with the key "outputStructure" */
+@property(assign) NSDictionary* outputStructure;
+
+/* Declare a property output port of type "Structure" and with the key "outputError" */
+@property(assign) NSDictionary* outputError;
+
+/* Declare a property output port of type "Number" and with the key "outputProgress" */
+@property(assign) double outputProgress;
+
+/* Declare a property output port of type "Index" and with the key "outputLoaded" */
+@property(assign) NSUInteger outputLoaded;
+
+/* Declare a property output port of type "Index" and with the key "outputCount" */
+@property(assign) NSUInteger outputCount;
+
+/* Declare a property output port of type "Boolean" and with the key "outputReady" */
+@property(assign) BOOL outputReady;
+
+@end
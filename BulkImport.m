@@ -0,0 +1,353 @@
+//
+//  BulkImport.m
+//  QC Utilities
+//
+//  Created by Randall Maas on 10/19/26.
+/*
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+ 
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+ 
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+
+#import "BulkImport.h"
+#import "StringImport.h"
+#import "src/HTTPLoader.h"
+#import <glob.h>
+
+/// The most files or URLs that can be loaded at the same time
+#define MaxLoads 32
+
+/** This is a patch to load many files or URLs at once.
+    Each one is loaded the same way as the String Importer does it.  Several are loaded at a time,
+    using Grand Central Dispatch Queues, but no more than the 'max loads' input allows; so a folder of
+    hundreds of files doesn't start hundreds of loads at once.  URLs from one host are started no
+    faster than the HTTPLoader lets them through.  Like the String Importer, we use a
+    timebase, and tell QC the interval to poll us for results from the background threads.
+ */
+@implementation BulkImport
+/// Holds the attributes for this plugin
+static NSDictionary* portAttributes;
++ (void) initialize
+{
+    RegisterExceptionHandler();
+    portAttributes =
+    @{
+      @"inputPattern":
+          @{
+              QCPortAttributeNameKey        : @"File path pattern",
+              QCPortAttributeDefaultValueKey: @"",
+              QCPortAttributeTypeKey        : QCPortTypeString
+           },
+      @"inputPaths":
+          @{
+              QCPortAttributeNameKey        : @"File paths or URLs",
+              QCPortAttributeTypeKey        : QCPortTypeStructure
+           },
+      @"inputMaxLoads":
+          @{
+              QCPortAttributeNameKey        : @"max loads",
+              QCPortAttributeDefaultValueKey: @8,
+              QCPortAttributeMinimumValueKey: @1,
+              QCPortAttributeMaximumValueKey: @MaxLoads,
+              QCPortAttributeTypeKey        : QCPortTypeIndex
+           },
+      @"outputStructure":
+          @{
+              QCPortAttributeNameKey: @"strings",
+              QCPortAttributeTypeKey: QCPortTypeStructure
+          },
+      @"outputError":
+          @{
+              QCPortAttributeNameKey: @"errors",
+              QCPortAttributeTypeKey: QCPortTypeStructure
+            },
+      @"outputProgress":
+          @{
+              QCPortAttributeNameKey: @"progress",
+              QCPortAttributeTypeKey: QCPortTypeNumber
+            },
+      @"outputLoaded":
+          @{
+              QCPortAttributeNameKey: @"loaded",
+              QCPortAttributeTypeKey: QCPortTypeIndex
+            },
+      @"outputCount":
+          @{
+              QCPortAttributeNameKey: @"count",
+              QCPortAttributeTypeKey: QCPortTypeIndex
+            },
+      @"outputReady":
+          @{
+              QCPortAttributeNameKey: @"ready",
+              QCPortAttributeTypeKey: QCPortTypeBoolean
+            }
+      };
+}
+
+/* We need to declare the input / output properties as dynamic as Quartz Composer will handle their implementation */
+@dynamic inputPattern, inputPaths, inputMaxLoads, outputStructure, outputError, outputProgress, outputLoaded, outputCount, outputReady;
+
++ (NSDictionary*) attributes
+{
+	/* Return the attributes of this plug-in */
+    return @{
+             QCPlugInAttributeNameKey       : @"Bulk Importer",
+             QCPlugInAttributeCopyrightKey  : @"Randall Maas (c) 2014",
+             QCPlugInAttributeCategoriesKey : @[@"Utility", @"Utility/File", @"Utility/String"],
+             QCPlugInAttributeDescriptionKey: @"Imports strings from the files matching a path pattern, and from a list of files or URLs.\n\n"
+                                              @"Each is loaded the same way as the String Importer does; several are loaded at a time.  "
+                                              @"The strings and errors are structures whose keys are the paths."
+             };
+}
+
++ (NSDictionary*) attributesForPropertyPortWithKey:(NSString*)key
+{
+	/* Return the attributes for the plug-in property ports */
+    return portAttributes[key];
+}
+
+
++ (QCPlugInExecutionMode) executionMode
+{
+	/* This plug-in is a processor (it just processes and may change with time) */
+	return kQCPlugInExecutionModeProcessor;
+}
+
++ (QCPlugInTimeMode) timeMode
+{
+    // Either idle or time base.  I'm going with timeBase
+	return kQCPlugInTimeModeTimeBase;
+}
+
+
+- (BOOL) startExecution:(id<QCPlugInContext>)context
+{
+    state = 0;
+    if (!scheduler)
+        scheduler = dispatch_queue_create("QCUtils.BulkImport", DISPATCH_QUEUE_SERIAL);
+    return YES;
+}
+
+- (void) stopExecution:(id<QCPlugInContext>)context
+{
+    // Ignore any loads still in flight
+    generation++;
+}
+
+
+/** Make the list of paths to load, from the path pattern and the list of paths
+    @returns The paths, in order, without duplicates
+ */
+- (NSArray*) paths
+{
+    NSMutableOrderedSet* paths = [[NSMutableOrderedSet alloc] init];
+
+    // Find the files matching the pattern
+    NSString* pattern = self.inputPattern;
+    if ([pattern length])
+    {
+        glob_t matches;
+        if (!glob([pattern fileSystemRepresentation], GLOB_TILDE, NULL, &matches))
+        {
+            for (size_t I = 0; I < matches.gl_pathc; I++)
+                [paths addObject: [[NSFileManager defaultManager] stringWithFileSystemRepresentation: matches.gl_pathv[I]
+                                                                                             length: strlen(matches.gl_pathv[I])]];
+        }
+        globfree(&matches);
+    }
+
+    // QC passes the list as a structure keyed by index; keep them in that order
+    NSDictionary* list = self.inputPaths;
+    NSArray* keys = [[list allKeys] sortedArrayUsingSelector: @selector(compare:)];
+    for (id key in keys)
+    {
+        id path = list[key];
+        if ([path isKindOfClass: [NSString class]] && [path length])
+            [paths addObject: path];
+    }
+    return [paths array];
+}
+
+
+/** Load all of the paths in the background, no more than max at a time
+    @param paths  The file paths or URLs to load
+    @param max    The most to load at the same time
+ */
+- (void) loadAll: (NSArray*) paths
+             max: (NSUInteger) max
+{
+    int myGeneration = generation;
+
+    // Each load blocks the thread it runs on until it is done.  They run on private serial queues
+    // ("lanes"), which get threads of their own, rather than on the global queues: GCD only has so
+    // many threads for those, and the file reads and HTTP callbacks that the loads wait on need them.
+    NSMutableArray* lanes = [[NSMutableArray alloc] init];
+    for (NSUInteger I = 0; I < max; I++)
+        [lanes addObject: dispatch_queue_create("QCUtils.BulkImport.lane", DISPATCH_QUEUE_SERIAL)];
+
+    // Note which host each URL is from, so that a list of URLs from one host doesn't take up all of
+    // the lanes waiting on the HTTPLoader's per host limit
+    NSMutableDictionary* hosts = [[NSMutableDictionary alloc] init];
+    for (NSString* path in paths)
+    {
+        NSURL* url = [NSURL URLWithString: path];
+        NSString* host = url ? [[HTTPLoader sharedLoader] hostKeyForURL: url] : nil;
+        if (host)
+            hosts[path] = host;
+    }
+
+    dispatch_async(scheduler, ^(void)
+                   {
+                       waiting   = [paths mutableCopy];
+                       freeLanes = lanes;
+                       pathHosts = hosts;
+                       hostLoads = [[NSMutableDictionary alloc] init];
+                       [self startLoads: myGeneration];
+                   });
+}
+
+
+/** Start loading the waiting paths, as long as there are free lanes.  Called on the scheduler queue
+    @param myGeneration  The inputs that the loads are for
+ */
+- (void) startLoads: (int) myGeneration
+{
+    NSUInteger perHost = [HTTPLoader sharedLoader].maxConnectionsPerHost;
+    while ([freeLanes count] && [waiting count] && myGeneration == generation)
+    {
+        // Take the first path whose host has room; local files don't have a host
+        NSUInteger index = [waiting indexOfObjectPassingTest: ^BOOL(NSString* path, NSUInteger idx, BOOL* stop)
+                            {
+                                NSString* host = pathHosts[path];
+                                return !host || [hostLoads[host] unsignedIntegerValue] < perHost;
+                            }];
+        if (NSNotFound == index)
+            return;
+        NSString* path = waiting[index];
+        [waiting removeObjectAtIndex: index];
+        NSString* host = pathHosts[path];
+        if (host)
+            hostLoads[host] = @([hostLoads[host] unsignedIntegerValue] + 1);
+        dispatch_queue_t lane = [freeLanes lastObject];
+        [freeLanes removeLastObject];
+
+        dispatch_async(lane, ^(void)
+                       {
+                           @autoreleasepool
+                           {
+                               NSError* e = nil;
+                               NSString* str = [StringImport stringWithContentsOfPath: path
+                                                                                error: &e];
+                               NSArray* err = str ? nil : NSError2Struct(e);
+                               dispatch_async(scheduler, ^(void)
+                                              {
+                                                  // Ignore loads for the old inputs.  This is checked under
+                                                  // the lock, since -execute: changes the inputs under it
+                                                  @synchronized(self)
+                                                  {
+                                                      if (myGeneration != generation)
+                                                          return;
+                                                      if (str)
+                                                          strings[path] = str;
+                                                      else
+                                                          errors[path] = err;
+                                                      completed++;
+                                                      state = 2;
+                                                  }
+                                                  if (host)
+                                                      hostLoads[host] = @([hostLoads[host] unsignedIntegerValue] - 1);
+                                                  [freeLanes addObject: lane];
+                                                  [self startLoads: myGeneration];
+                                              });
+                           }
+                       });
+    }
+}
+
+
+/**@brief Tell QC how frequently to poll us for updates; it depends on whether are waiting for
+    for results from the background
+ */
+- (NSTimeInterval) executionTimeForContext:(id<QCPlugInContext>)context
+                                    atTime:(NSTimeInterval)time
+                             withArguments:(NSDictionary*)arguments
+{
+    // See if we are waiting on stuff and should just check
+    if (state < 4)
+        return 0.001;
+    // Check to see if an input change
+    if ([self didValueForInputKeyChange:@"inputPattern"] || [self didValueForInputKeyChange:@"inputPaths"]
+        || [self didValueForInputKeyChange:@"inputMaxLoads"])
+        return 0.0;
+    return 100000000.0;
+}
+
+/** @brief This method is called by Quartz Composer whenever the plug-in needs to recompute its result
+    @param context
+    @param time
+    @param arguments
+ */
+- (BOOL) execute:(id<QCPlugInContext>)context
+          atTime:(NSTimeInterval)time
+   withArguments:(NSDictionary*)arguments
+{
+    // Check that this isn't the first call, and that things haven't changed
+    if ([self didValueForInputKeyChange:@"inputPattern"] || [self didValueForInputKeyChange:@"inputPaths"]
+        || [self didValueForInputKeyChange:@"inputMaxLoads"] || !state)
+    {
+        NSArray* paths = [self paths];
+        @synchronized(self)
+        {
+            // Forget the loads for the old inputs
+            generation++;
+            strings   = [[NSMutableDictionary alloc] init];
+            errors    = [[NSMutableDictionary alloc] init];
+            total     = [paths count];
+            completed = 0;
+            state     = total ? 1 : 2;
+        }
+        self . outputStructure = @{};
+        self . outputError     = @{};
+        self . outputProgress  = 0.0;
+        self . outputLoaded    = 0;
+        self . outputCount     = total;
+        self . outputReady     = false;
+        if (total)
+            [self loadAll: paths
+                      max: MIN(MAX(self.inputMaxLoads, 1), MaxLoads)];
+        return YES;
+    }
+
+    // See if there is anything new
+    if (2 != state)
+        return YES;
+
+    // Update our results
+    @synchronized(self)
+    {
+        state = completed < total ? 3 : 4;
+        self . outputStructure = [strings copy];
+        self . outputError     = [errors copy];
+        self . outputProgress  = total ? (double) completed / total : 1.0;
+        self . outputLoaded    = completed;
+        self . outputReady     = completed == total && ![errors count];
+    }
+	return YES;
+}
+
+@end
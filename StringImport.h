@@ -25,16 +25,21 @@
 
 
 #import "QCUtils.h"
+#import "src/FileTail.h"
 
 /** A Quartz Plugin to import a string from a file or remote server */
 @interface StringImport : QCPlugIn
 {
     // The state is 0: starting, 1: trying to load, 2:
     int volatile state;
+    // Changes each time the inputs change, so that loads for the old inputs are ignored
+    int volatile generation;
     // The loaded json data
     NSString* volatile string;
     // The error message, if any
     NSArray* volatile errorMsg;
+    // Follows the file when watching it for changes; nil otherwise
+    FileTail* tail;
 }
 
 /* Declare a property input port of type "String" and with the key "inputURL"
@@ -42,6 +47,16 @@
  */
 @property(assign) NSString* inputURL;
 
+/* Declare a property input port of type "Boolean" and with the key "inputWatch"
+ If true, and the string is from a local file, the file is followed as it is appended to.
+ */
+@property(assign) BOOL inputWatch;
+
+/* Declare a property input port of type "Index" and with the key "inputMaxLength"
+ When watching a file, only this many characters from the end of the file are kept; zero keeps them all.
+ */
+@property(assign) NSUInteger inputMaxLength;
+
 
 /* Declare a property output port of type "String" and with the key "outputStructure" */
 @property(assign) NSString* outputString;
@@ -52,4 +67,13 @@
 /* Declare a property output port of type "Boolean" and with the key "outputReady" */
 @property(assign) BOOL outputReady;
 
+/** Load a string the way this patch does: first as a file path, then as a URL.  Compressed data is
+    decompressed.  This blocks until the string is loaded, so don't call it on the main queue.
+    @param path   The file path or URL
+    @param error  Where to put the reason, if the string couldn't be loaded
+    @returns The string; nil on error
+ */
++ (NSString*) stringWithContentsOfPath: (NSString*) path
+                                 error: (NSError**) error;
+
 @end
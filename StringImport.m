@@ -25,12 +25,133 @@
 
 
 #import "StringImport.h"
+#import "src/StreamDecoder.h"
+#import "src/HTTPLoader.h"
+
+/** This is the text followed so far from a watched file.  Each FileTail has its own, used only
+    on that FileTail's queue, so none of this needs locking.
+ */
+@interface TailText : NSObject
+- (instancetype) initWithMaxLength: (NSUInteger) maxLength;
+- (void) reset;
+- (NSString*) append: (NSData*) data;
+- (NSString*) text;
+@end
+
+@implementation TailText
+{
+    /// The text followed so far
+    NSMutableString* text;
+    /// The bytes at the end of what was read that are not yet a whole UTF-8 character
+    NSMutableData* partial;
+    /// The most characters to keep; zero for no limit
+    NSUInteger maxLength;
+    /// True until the first bytes after a reset have been appended
+    BOOL atStart;
+}
+
+- (instancetype) initWithMaxLength: (NSUInteger) aMaxLength
+{
+    if (!(self = [super init]))
+        return nil;
+    maxLength = aMaxLength;
+    [self reset];
+    return self;
+}
+
+
+/// Forget the text; the next bytes are from the start of the file (or of the window read from it)
+- (void) reset
+{
+    text    = [[NSMutableString alloc] init];
+    partial = [[NSMutableData alloc] init];
+    atStart = YES;
+}
+
+
+/** Find how many of the bytes are whole UTF-8 characters; the rest are the start of a character
+    whose remaining bytes haven't been written yet.
+    @param bytes  The bytes to check
+    @param length The number of bytes
+    @returns The number of bytes up to the last whole character
+ */
+static NSUInteger UTF8WholeLength(const uint8_t* bytes, NSUInteger length)
+{
+    // Look back, at most, the length of the longest UTF-8 character for its lead byte
+    for (NSUInteger I = 1; I <= 4 && I <= length; I++)
+    {
+        uint8_t b = bytes[length - I];
+        // Skip the continuation bytes
+        if (0x80 == (b & 0xC0))
+            continue;
+        // Plain ASCII is always whole
+        if (b < 0x80)
+            return length;
+        // See if the lead byte has all of the bytes that it needs
+        NSUInteger needed = b >= 0xF0 ? 4 : b >= 0xE0 ? 3 : 2;
+        return needed > I ? length - I : length;
+    }
+    return length;
+}
+
+
+/** Add the bytes appended to the file
+    @param data  The appended bytes
+    @returns The whole characters that were added; nil if the bytes are not UTF-8
+ */
+- (NSString*) append: (NSData*) data
+{
+    if (atStart && [data length])
+    {
+        // The window may start part way into a character; skip to the next whole one
+        atStart = NO;
+        const uint8_t* bytes = [data bytes];
+        NSUInteger skip = 0;
+        while (skip < 3 && skip < [data length] && 0x80 == (bytes[skip] & 0xC0))
+            skip++;
+        if (skip)
+            data = [data subdataWithRange: NSMakeRange(skip, [data length] - skip)];
+    }
+
+    // Only convert whole characters; keep the rest for when the next bytes are appended
+    [partial appendData: data];
+    NSUInteger length = UTF8WholeLength([partial bytes], [partial length]);
+    NSString* added = [[NSString alloc] initWithBytes: [partial bytes]
+                                               length: length
+                                             encoding: NSUTF8StringEncoding];
+    [partial replaceBytesInRange: NSMakeRange(0, length)
+                       withBytes: NULL
+                          length: 0];
+    if (!added)
+        return nil;
+    [text appendString: added];
+
+    // Keep only the end of the text, so that copying it out stays cheap
+    if (maxLength && [text length] > maxLength)
+    {
+        NSRange first = [text rangeOfComposedCharacterSequenceAtIndex: [text length] - maxLength];
+        [text deleteCharactersInRange: NSMakeRange(0, first.location)];
+    }
+    return added;
+}
+
+
+/// A snapshot of the text followed so far
+- (NSString*) text
+{
+    return [text copy];
+}
+@end
+
 
 /** This is a patch to load the a JSON file from storage or remotely.
     It does the loading using a Grand Central Dispatch Queue -- ie a background thread.
     The Quartz Composer is allowed to do other things while it loads.
     To let QC know that the loading is done, we use a timebase, and tell QC the interval to poll us
     for results from the background thread.
+    Compressed (gzip or zstd) files are decompressed as they are loaded; see StreamDecoder.
+    If asked to watch a local file, it follows the file (see FileTail) and passes along the text as
+    it is appended, instead of loading it once.
  */
 @implementation StringImport
 /// Holds the attributes for this plugin
@@ -46,6 +167,19 @@ static NSDictionary* portAttributes;
               QCPortAttributeDefaultValueKey: @"",
               QCPortAttributeTypeKey        : QCPortTypeString
            },
+      @"inputWatch":
+          @{
+              QCPortAttributeNameKey        : @"watch file for changes",
+              QCPortAttributeDefaultValueKey: @NO,
+              QCPortAttributeTypeKey        : QCPortTypeBoolean
+           },
+      @"inputMaxLength":
+          @{
+              QCPortAttributeNameKey        : @"max length when watching",
+              QCPortAttributeDefaultValueKey: @65536,
+              QCPortAttributeMinimumValueKey: @0,
+              QCPortAttributeTypeKey        : QCPortTypeIndex
+           },
       @"outputString":
           @{
               QCPortAttributeNameKey: @"string",
@@ -65,7 +199,7 @@ static NSDictionary* portAttributes;
 }
 
 /* We need to declare the input / output properties as dynamic as Quartz Composer will handle their implementation */
-@dynamic inputURL, outputString, outputError, outputReady;
+@dynamic inputURL, inputWatch, inputMaxLength, outputString, outputError, outputReady;
 
 + (NSDictionary*) attributes
 {
@@ -76,7 +210,9 @@ static NSDictionary* portAttributes;
              QCPlugInAttributeCategoriesKey : @[@"Utility", @"Utility/File", @"Utility/String"],
              QCPlugInAttributeDescriptionKey: @"Imports a string from a file or URL.\n\n"
                                               @"It first assumes that it was given a file path and tries to load from that.  "
-                                              @"If that doesn't work, it assumes that it was given an URL and tries to load from that."
+                                              @"If that doesn't work, it assumes that it was given an URL and tries to load from that.  "
+                                              @"Compressed (gzip or zstd) data is decompressed.\n\n"
+                                              @"If 'watch file for changes' is set and it was given a local file, the string is updated as the file is appended to."
              };
 }
 
@@ -107,52 +243,181 @@ static NSDictionary* portAttributes;
     return YES;
 }
 
-// - (void) stopExecution:(id<QCPlugInContext>)context
-- (void) load: (NSString*) path
+- (void) stopExecution:(id<QCPlugInContext>)context
+{
+    // Stop following the file, and ignore any load still in flight
+    [tail cancel];
+    tail = nil;
+    generation++;
+}
+
+- (void) dealloc
+{
+    [tail cancel];
+}
+
+
+/** Hand the results from a background thread over to execute
+    @param str           The loaded string; nil if it couldn't be loaded
+    @param err           The error message structure
+    @param myGeneration  The inputs that the results are for
+ */
+- (void) publish: (NSString*) str
+           error: (NSArray*) err
+      generation: (int) myGeneration
+{
+    // Execute takes the string and error together, so they have to change together.  Results for
+    // the old inputs are ignored; this is checked under the lock, since execute changes them under it
+    @synchronized(self)
+    {
+        if (myGeneration != generation)
+            return;
+        string   = str;
+        errorMsg = err;
+        state    = 2;
+    }
+}
+
+
+/** Called by the FileTail (on its queue) with the bytes appended to the file being watched
+    @param buffer        The text followed so far from that file
+    @param data          The appended bytes
+    @param reset         True if the file was truncated or replaced and the bytes are from the start of the file
+    @param e             The error, if the file couldn't be read
+    @param myGeneration  The inputs that the file is being followed for
+ */
+- (void) tail: (TailText*) buffer
+     appended: (NSData*) data
+        reset: (BOOL) reset
+        error: (NSError*) e
+   generation: (int) myGeneration
+{
+    if (reset)
+        [buffer reset];
+    if (!data)
+    {
+        [self publish: nil
+                error: NSError2Struct(e)
+           generation: myGeneration];
+        return;
+    }
+
+    NSString* text = [buffer append: data];
+    if (!text)
+    {
+        [self publish: [buffer text]
+                error: @[@{@"description": @"The file is not UTF-8 text."}]
+           generation: myGeneration];
+        return;
+    }
+    if (![text length] && !reset)
+        return;
+
+    // Hand a snapshot over to be output
+    [self publish: [buffer text]
+            error: @[]
+       generation: myGeneration];
+}
+
+
+/** Start following the file, if it is a local file
+    @param path          The file path or file URL
+    @param myGeneration  The inputs that the file is being followed for
+    @returns true if the file is being followed, false if it isn't a local file
+ */
+- (BOOL) watch: (NSString*) path
+    generation: (int) myGeneration
+{
+    NSURL* url = [NSURL URLWithString: path];
+    if ([url isFileURL])
+        path = [url path];
+    else if (url && [url scheme])
+        return NO;
+
+    // Each FileTail has its own text, which is only used on its queue; a FileTail that is being
+    // replaced may still be running its handler while the new one starts
+    __weak StringImport* weakSelf = self;
+    NSUInteger maxLength = self.inputMaxLength;
+    TailText* buffer = [[TailText alloc] initWithMaxLength: maxLength];
+    tail = [[FileTail alloc] initWithPath: path
+                                  handler: ^(FileTail* sender, NSData* data, BOOL reset, NSError* e)
+            {
+                @autoreleasepool
+                {
+                    [weakSelf tail: buffer
+                          appended: data
+                             reset: reset
+                             error: e
+                        generation: myGeneration];
+                }
+            }];
+    // A UTF-8 character is at most 4 bytes, so this is enough bytes for the characters kept
+    tail.maxLength = maxLength * 4;
+    [tail start];
+    return YES;
+}
+
+
+/// Load a string from a file or URL; see StringImport.h
++ (NSString*) stringWithContentsOfPath: (NSString*) path
+                                 error: (NSError**) error
 {
     // Try loading the data as file
     NSError *e = nil;
-    state = 0;
-    NSData* data = [NSData dataWithContentsOfFile: path
-                                          options: 0
-                                            error: &e];
+    NSData* data = [StreamDecoder dataWithContentsOfFile: path
+                                                   error: &e];
+    // A file that was read but couldn't be decompressed is an error in its own right
+    if (!data && ![StreamDecoder isReadError: e])
+    {
+        if (error)
+            *error = e;
+        return nil;
+    }
     if (!data)
     {
         // That didn't work.  Try loading it from a URL (which can be slow)
-        // We will background the download and come back later
-        // First, create an error message, for the duration:
-        errorMsg =  NSError2Struct(e);
-        state = 1;
-
-        e = nil;
         NSURL* url =[NSURL URLWithString: path];
         // If it is just a file name, we have to try a backup method
         if (!url)
-            url = [NSURL fileURLWithPath:self.inputURL];
+            url = [NSURL fileURLWithPath: path];
         // We have to do this as the path may not be a valid URL and return a null
         if (url)
-            data = [NSData dataWithContentsOfURL: url
-                                         options: 0
-                                           error:&e];
-
-        // Check to see if there is any data
-        if (!data)
         {
-            errorMsg =  NSError2Struct(e);
-        }
-        else
-        {
-            errorMsg = @[];
+            e = nil;
+            data = [[HTTPLoader sharedLoader] dataWithContentsOfURL: url
+                                                              error: &e];
         }
     }
 
-    if (data)
+    // Check to see if there is any data
+    if (!data)
     {
-        // convert to a regular file
-        string = [[NSString alloc] initWithData: data
-                                       encoding: NSUTF8StringEncoding];
+        if (error)
+            *error = e;
+        return nil;
     }
-    state = 2;
+
+    // convert to a regular file
+    NSString* str = [[NSString alloc] initWithData: data
+                                          encoding: NSUTF8StringEncoding];
+    if (!str && error)
+        *error = [NSError errorWithDomain: NSCocoaErrorDomain
+                                     code: NSFileReadInapplicableStringEncodingError
+                                 userInfo: @{NSFilePathErrorKey: path}];
+    return str;
+}
+
+
+/// Load the string in the background, and pass it along to execute
+- (void) load: (NSString*) path
+   generation: (int) myGeneration
+{
+    NSError *e = nil;
+    NSString* str = [StringImport stringWithContentsOfPath: path
+                                                     error: &e];
+    [self publish: str
+            error: NSError2Struct(e)
+       generation: myGeneration];
 }
 
 
@@ -167,8 +432,12 @@ static NSDictionary* portAttributes;
     if (state < 3)
         return 0.001;
     // Check to see if an input change
-    if ([self didValueForInputKeyChange:@"inputURL"])
+    if ([self didValueForInputKeyChange:@"inputURL"] || [self didValueForInputKeyChange:@"inputWatch"]
+        || [self didValueForInputKeyChange:@"inputMaxLength"])
         return 0.0;
+    // When following a file, check for appended text as often as the file is read
+    if (tail)
+        return tail.debounce;
     return 100000000.0;
 }
 
@@ -182,15 +451,27 @@ static NSDictionary* portAttributes;
    withArguments:(NSDictionary*)arguments
 {
     // Check that this isn't the first call, and that things haven't changed
-    if ([self didValueForInputKeyChange:@"inputURL"] || (!string && !state) )
+    if ([self didValueForInputKeyChange:@"inputURL"] || [self didValueForInputKeyChange:@"inputWatch"]
+        || [self didValueForInputKeyChange:@"inputMaxLength"]
+        || (!string && !state) )
     {
+        // Stop following the previous file, if any
+        [tail cancel];
+        tail = nil;
+
         // try loading the URL
-        // The "preferred" way in 10.9 is use NSURLSession, but I'm using 10.8
+        // The "preferred" way in 10.9 is use NSURLSession, but I'm using 10.8; see HTTPLoader
         NSString* url = self.inputURL;
-        state = 1;
-        errorMsg = nil;
-        string = nil;
-        errorMsg = self . outputError= @[];
+        int myGeneration;
+        @synchronized(self)
+        {
+            // Forget the load for the old inputs
+            myGeneration = ++generation;
+            state = 1;
+            string = nil;
+            errorMsg = @[];
+        }
+        self . outputError= @[];
         self . outputString = @"";
         self . outputReady=false;
         // This doesn't use the main queue cuz some URL connections will cause the QC to stop responding
@@ -199,26 +480,40 @@ static NSDictionary* portAttributes;
         {
             state = 3;
         }
+        else if (self.inputWatch && [self watch: url
+                                     generation: myGeneration])
+        {
+            // The FileTail reads the file in the background
+        }
         else
             dispatch_async(dispatch_get_global_queue( DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(void)
                            {
                                @autoreleasepool
                                {
-                                   [self load:url];
+                                   [self load: url
+                                   generation: myGeneration];
                                }
                            });
         return YES;
     }
 
-    // See if we are done processing yet
-    if (state < 2)
-        return YES;
+    // Take the results, if we are done processing yet; a background thread may be handing over
+    // newer ones, so take them together
+    NSString* str;
+    NSArray* err;
+    @synchronized(self)
+    {
+        if (state != 2)
+            return YES;
+        state = 3;
+        str = string;
+        err = errorMsg;
+    }
 
     // Update our results
-    state = 3;
-    self . outputString = string;
-    self . outputError = errorMsg;
-    self . outputReady = (string != nil) && ![@"" isEqual: string];
+    self . outputString = str;
+    self . outputError = err;
+    self . outputReady = (str != nil) && ![@"" isEqual: str];
 	return YES;
 }
 
@@ -0,0 +1,75 @@
+//
+//  FileTail.h
+//  QC Utilities
+//
+//  Created by Randall Maas on 10/19/26.
+/*
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+ 
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+ 
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+
+#import <Foundation/Foundation.h>
+
+@class FileTail;
+
+/** Called with the bytes appended to a followed file.
+    @param tail   The object following the file
+    @param data   The newly appended bytes; nil if there was an error
+    @param reset  True if the file was truncated or replaced, and data starts from the beginning of the file
+    @param error  The reason the file couldn't be opened or read; nil otherwise
+ */
+typedef void (^FileTailHandler)(FileTail* tail, NSData* data, BOOL reset, NSError* error);
+
+/** This is a class that follows a file that another process is appending to, like "tail -F".
+    It is driven by file system notifications (a Grand Central Dispatch vnode source, which is
+    kqueue on Mac OS X) rather than by polling.  Only the bytes past the last offset are read;
+    the file is never reloaded unless it is truncated, replaced, deleted, or renamed (eg log
+    rotation).  A followed file that goes missing is given a few seconds to be recreated before
+    that is reported.
+    Bursts of notifications are coalesced so that the handler is called at most once per
+    debounce interval, with everything that was appended in that time.
+ */
+@interface FileTail : NSObject
+
+/** Create the object to follow a file; call start to begin.
+    @param path     The local file path to follow
+    @param handler  The block to pass the appended bytes to
+ */
+- (instancetype) initWithPath: (NSString*) path
+                      handler: (FileTailHandler) handler;
+
+/// Start following the file.  The handler is first called with the current contents of the file,
+/// and then with each batch of appended bytes.  The handler is called on a background queue.
+- (void) start;
+
+/// Stop following the file; the handler will not be called after this
+- (void) cancel;
+
+/// The local file path being followed
+@property(readonly) NSString* path;
+
+/// How long to wait after a change before reading, so that bursts of writes are read together.
+/// The default is 50ms
+@property NSTimeInterval debounce;
+
+/// The most bytes to pass along from the end of the file; anything before that is skipped, and
+/// the handler is told to reset.  Zero, the default, means there is no limit
+@property NSUInteger maxLength;
+
+@end
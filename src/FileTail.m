@@ -0,0 +1,319 @@
+//
+//  FileTail.m
+//  QC Utilities
+//
+//  Created by Randall Maas on 10/19/26.
+/*
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+ 
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+ 
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+
+#import "FileTail.h"
+#import <sys/stat.h>
+#import <fcntl.h>
+#import <unistd.h>
+
+/// The most that will be read from the file in one call to pread
+#define MaxReadSize (1024*1024)
+/// How long to wait before trying to reopen a file that has gone missing
+#define RetryInterval 1.0
+/// How long a file that was being followed can be missing before that is reported; a rotated
+/// log is usually recreated shortly after the old one is moved away
+#define RotationGrace 5.0
+/// The number of bytes at the start of the file that are kept, to tell if it has been rewritten
+#define HeadSize 64
+
+@implementation FileTail
+{
+    /// The block to pass the appended bytes to
+    FileTailHandler handler;
+    /// The queue that the notifications, reads and the handler are serialized on
+    dispatch_queue_t queue;
+    /// The file system notification source for the open file
+    dispatch_source_t source;
+    /// The open file; -1 if the file is not open
+    int fd;
+    /// The offset of the next byte to read
+    off_t offset;
+    /// The device and inode of the open file, to tell if the path now refers to a different file
+    dev_t device;
+    ino_t inode;
+    /// The first bytes of the file, to tell if it was truncated and rewritten past our offset
+    NSData* head;
+    /// True if the file got shorter since it was last read
+    bool shrank;
+    /// True once the file has been opened; after that, it going missing is probably a rotation
+    bool followed;
+    /// When the file was found to be missing; zero if it isn't
+    CFAbsoluteTime missingSince;
+    /// True once the handler has been told that the file is missing
+    bool missingReported;
+    /// True if a read is already scheduled; used to coalesce notifications
+    bool pending;
+    /// True once the caller is no longer interested
+    bool volatile cancelled;
+}
+
+- (instancetype) initWithPath: (NSString*) path
+                      handler: (FileTailHandler) aHandler
+{
+    // Tradition: initialize in the base
+    if (!(self = [super init]))
+        return self;
+
+    _path    = [path copy];
+    _debounce= 0.05;
+    handler  = [aHandler copy];
+    fd       = -1;
+    queue    = dispatch_queue_create("QCUtils.FileTail", DISPATCH_QUEUE_SERIAL);
+    dispatch_set_target_queue(queue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0));
+    return self;
+}
+
+
+/// Start following the file
+- (void) start
+{
+    // Open the file and read what is already there
+    dispatch_async(queue, ^(void)
+                   {
+                       [self openFile];
+                   });
+}
+
+- (void) dealloc
+{
+    [self closeFile];
+}
+
+
+/// Stop following the file
+- (void) cancel
+{
+    cancelled = true;
+    dispatch_async(queue, ^(void)
+                   {
+                       [self closeFile];
+                   });
+}
+
+
+/// Stop watching the file and close it.  Must be called on the queue (or from dealloc)
+- (void) closeFile
+{
+    if (source)
+    {
+        // The cancel handler closes the file
+        dispatch_source_cancel(source);
+        source = nil;
+    }
+    else if (fd >= 0)
+        close(fd);
+    fd = -1;
+}
+
+
+/** Open the file, start watching it for changes, and read everything in it.
+    If the file can't be opened we try again later.  If we were already following it, it is
+    probably being rotated, so the error is only passed to the handler if it stays missing.
+ */
+- (void) openFile
+{
+    if (cancelled)
+        return;
+    [self closeFile];
+    offset = 0;
+    head   = nil;
+    shrank = false;
+
+    struct stat st;
+    fd = open([_path fileSystemRepresentation], O_RDONLY);
+    if (fd < 0 || fstat(fd, &st))
+    {
+        int err = errno;
+        [self closeFile];
+        CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+        if (!missingSince)
+            missingSince = now;
+        // Wait quietly, and check often, for a rotated file to be recreated
+        BOOL rotating = followed && now - missingSince < RotationGrace;
+        if (!rotating && !missingReported)
+        {
+            missingReported = true;
+            handler(self, nil, YES, [NSError errorWithDomain: NSPOSIXErrorDomain
+                                                        code: err
+                                                    userInfo: @{NSFilePathErrorKey: _path}]);
+        }
+        [self scheduleAfter: rotating ? _debounce : RetryInterval];
+        return;
+    }
+    device          = st.st_dev;
+    inode           = st.st_ino;
+    followed        = true;
+    missingSince    = 0;
+    missingReported = false;
+
+    // Watch for writes, and for the file being replaced out from under us
+    source = dispatch_source_create(DISPATCH_SOURCE_TYPE_VNODE, fd,
+                                    DISPATCH_VNODE_WRITE  | DISPATCH_VNODE_EXTEND | DISPATCH_VNODE_ATTRIB |
+                                    DISPATCH_VNODE_DELETE | DISPATCH_VNODE_RENAME | DISPATCH_VNODE_REVOKE,
+                                    queue);
+    int sourceFd = fd;
+    dispatch_source_t src = source;
+    __weak FileTail* weakSelf = self;
+    dispatch_source_set_event_handler(source, ^(void)
+                                      {
+                                          [weakSelf changed: dispatch_source_get_data(src)];
+                                      });
+    dispatch_source_set_cancel_handler(source, ^(void)
+                                       {
+                                           close(sourceFd);
+                                       });
+    dispatch_resume(source);
+
+    // Pass along what is already in the file
+    [self readAppended];
+}
+
+
+/// Called on the queue when the file system reports a change to the file
+- (void) changed: (unsigned long) flags
+{
+    if (cancelled)
+        return;
+    if (flags & (DISPATCH_VNODE_DELETE | DISPATCH_VNODE_RENAME | DISPATCH_VNODE_REVOKE))
+    {
+        // The file was rotated or removed; anything written to the old one after this is lost,
+        // so read what is left and then follow the new file
+        [self readAppended];
+        [self closeFile];
+    }
+    else if (fd >= 0)
+    {
+        // Note a truncation now; by the time the debounced read happens, the file may have
+        // been written past our offset again
+        struct stat st;
+        if (!fstat(fd, &st) && st.st_size < offset)
+            shrank = true;
+    }
+    [self scheduleAfter: _debounce];
+}
+
+
+/** Read the file (or reopen it, if it was closed) on the queue after a delay, unless that is
+    already scheduled.  This is what coalesces a burst of notifications into one read.
+ */
+- (void) scheduleAfter: (NSTimeInterval) delay
+{
+    if (pending)
+        return;
+    pending = true;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), queue, ^(void)
+                   {
+                       pending = false;
+                       if (cancelled)
+                           return;
+                       if (fd < 0)
+                           [self openFile];
+                       else
+                           [self readAppended];
+                   });
+}
+
+
+/// Read the bytes appended since the last read, and pass them to the handler all at once
+- (void) readAppended
+{
+    if (fd < 0 || cancelled)
+        return;
+    struct stat st;
+    if (fstat(fd, &st))
+        return;
+
+    // If the path now refers to a different file (it was replaced without us being told), follow that one
+    struct stat pathSt;
+    if (!stat([_path fileSystemRepresentation], &pathSt) && (pathSt.st_dev != device || pathSt.st_ino != inode))
+    {
+        [self openFile];
+        return;
+    }
+
+    // If the file got shorter, or its start is no longer what it was, it was truncated (and maybe
+    // written past our offset since); start over from the beginning
+    BOOL reset = !offset;
+    if (shrank || st.st_size < offset || ![self sameHead])
+    {
+        offset = 0;
+        head   = nil;
+        reset  = YES;
+    }
+    shrank = false;
+    // Skip anything that is older than the window; what is passed along no longer follows on
+    // from what was passed before
+    if (_maxLength && st.st_size - offset > (off_t) _maxLength)
+    {
+        offset = st.st_size - _maxLength;
+        reset = YES;
+    }
+    if (offset >= st.st_size && !reset)
+        return;
+
+    @autoreleasepool
+    {
+        NSMutableData* data = [NSMutableData dataWithLength: (NSUInteger)(st.st_size - offset)];
+        NSUInteger length = 0;
+        while (offset < st.st_size && !cancelled)
+        {
+            size_t size = (size_t) MIN(st.st_size - offset, MaxReadSize);
+            ssize_t count = pread(fd, (uint8_t*)[data mutableBytes] + length, size, offset);
+            if (count <= 0)
+                break;
+            length += count;
+            offset += count;
+        }
+        [data setLength: length];
+        if (!cancelled && (length || reset))
+            handler(self, data, reset, nil);
+    }
+
+    // Remember the start of the file, until there is enough of it to tell it apart
+    if ([head length] < HeadSize)
+        head = [self readHead: (NSUInteger) MIN(st.st_size, HeadSize)];
+}
+
+
+/// Read the first bytes of the file
+- (NSData*) readHead: (NSUInteger) size
+{
+    NSMutableData* bytes = [NSMutableData dataWithLength: size];
+    ssize_t count = pread(fd, [bytes mutableBytes], size, 0);
+    [bytes setLength: count > 0 ? count : 0];
+    return bytes;
+}
+
+
+/// Check that the start of the file is still what it was when we last read it
+- (BOOL) sameHead
+{
+    if (![head length])
+        return YES;
+    return [head isEqualToData: [self readHead: [head length]]];
+}
+
+@end
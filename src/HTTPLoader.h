@@ -0,0 +1,73 @@
+//
+//  HTTPLoader.h
+//  QC Utilities
+//
+//  Created by Randall Maas on 10/19/26.
+/*
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+ 
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+ 
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+
+#import <Foundation/Foundation.h>
+
+/** This is a class that the patches share to load the contents of URLs.
+    Unlike [NSData dataWithContentsOfURL:] it
+    - reuses connections to a host (HTTP keep-alive, from the system's connection pool)
+    - limits how many loads from one host can be in flight at a time; the rest wait their turn
+    - gives up on a server that doesn't connect, or stops sending, within a deadline
+    - resumes a download that was cut short from where it left off (with a Range request),
+      if the server supports that, rather than starting over
+    - decompresses the body as it arrives (see StreamDecoder)
+    URLs that aren't http or https are loaded by the system as before.
+ */
+@interface HTTPLoader : NSObject
+
+/// This gets the single instance that the patches share
++ (instancetype) sharedLoader;
+
+/** Load the contents of a URL.
+    This blocks until the load is done (or gives up), so don't call it on the main queue.
+    @param url    The URL to load
+    @param error  Where to put the reason, if the URL couldn't be loaded
+    @returns The decompressed contents; nil on error
+ */
+- (NSData*) dataWithContentsOfURL: (NSURL*) url
+                            error: (NSError**) error;
+
+/** Get the key that the loads in flight to a host are counted by
+    @param url  The URL to be loaded
+    @returns The host and port (with the scheme's default port filled in); nil if the URL isn't http or https
+ */
+- (NSString*) hostKeyForURL: (NSURL*) url;
+
+/// How long to wait for the server to respond, in seconds, including any time spent waiting for
+/// a turn with the host.  The default is 15
+@property NSTimeInterval connectTimeout;
+
+/// How long to wait for more of the body, once the server has responded, in seconds.  The default is 30
+@property NSTimeInterval readTimeout;
+
+/// The most loads from one host that can be in flight at a time.  The default is 4.
+/// Changing it only affects hosts that haven't been loaded from yet
+@property NSUInteger maxConnectionsPerHost;
+
+/// How many times to resume a download that was cut short.  The default is 3
+@property NSUInteger maxResumes;
+
+@end
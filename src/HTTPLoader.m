@@ -0,0 +1,452 @@
+//
+//  HTTPLoader.m
+//  QC Utilities
+//
+//  Created by Randall Maas on 10/19/26.
+/*
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+ 
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+ 
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+
+#import "HTTPLoader.h"
+#import "StreamDecoder.h"
+
+/// How often to check whether a load has gone past its deadline, in seconds
+#define WatchdogInterval 1.0
+
+
+/// Look up a header, ignoring the case of its name
+static NSString* Header(NSDictionary* headers, NSString* name)
+{
+    for (NSString* key in headers)
+        if (NSOrderedSame == [key caseInsensitiveCompare: name])
+            return headers[key];
+    return nil;
+}
+
+
+/** This is one load of a URL, including the requests to resume it if the connection drops.
+    The connection's delegate messages, and the deadline checks, are all serialized on one
+    operation queue, so none of this needs locking.
+ */
+@interface HTTPLoad : NSObject <NSURLConnectionDataDelegate>
+- (instancetype) initWithURL: (NSURL*) url
+                      loader: (HTTPLoader*) loader
+                    queuedAt: (CFAbsoluteTime) queuedAt;
+- (NSData*) run: (NSError**) error;
+@end
+
+@implementation HTTPLoad
+{
+    /// The URL being loaded
+    NSURL* url;
+    /// Copied from the loader, so that changing them doesn't affect loads in flight
+    NSTimeInterval connectTimeout, readTimeout;
+    /// How many more times the download can be resumed
+    NSUInteger resumesLeft;
+
+    /// The queue that the connection's delegate messages are sent on
+    NSOperationQueue* queue;
+    /// The current connection; nil once the load is done
+    NSURLConnection* connection;
+    /// Checks that the server is still sending
+    dispatch_source_t watchdog;
+    /// When something was last heard from the server
+    CFAbsoluteTime lastActivity;
+    /// When the load started waiting for its turn with the host; that counts against the
+    /// connect deadline.  Zero once the first request has been started
+    CFAbsoluteTime queuedAt;
+    /// True once the server has responded on the current connection
+    BOOL responded;
+
+    /// Decompresses the body as it arrives
+    StreamDecoder* decoder;
+    /// The decompressed body so far
+    NSMutableData* output;
+    /// The number of body bytes (as sent by the server) received so far
+    long long received;
+    /// The ETag or Last-Modified of the body, so that a resume is known to be of the same body
+    NSString* validator;
+    /// True if the server can send the rest of the body, if the connection is cut short
+    BOOL resumable;
+
+    /// Signalled when the load is done
+    dispatch_semaphore_t done;
+    /// The reason the load failed, if it did
+    NSError* failure;
+}
+
+- (instancetype) initWithURL: (NSURL*) aURL
+                      loader: (HTTPLoader*) loader
+                    queuedAt: (CFAbsoluteTime) aQueuedAt
+{
+    // Tradition: initialize in the base
+    if (!(self = [super init]))
+        return self;
+    url            = aURL;
+    connectTimeout = loader.connectTimeout;
+    readTimeout    = loader.readTimeout;
+    resumesLeft    = loader.maxResumes;
+    queuedAt       = aQueuedAt;
+    queue          = [[NSOperationQueue alloc] init];
+    [queue setMaxConcurrentOperationCount: 1];
+    done           = dispatch_semaphore_create(0);
+    return self;
+}
+
+
+/// Load the URL, and wait for it to be done
+- (NSData*) run: (NSError**) error
+{
+    // Check the deadline periodically; on a private queue, like StreamDecoder's, so that it fires
+    // even if the global queue threads are all busy
+    watchdog = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0,
+                                      dispatch_queue_create("QCUtils.HTTPLoader.watchdog", DISPATCH_QUEUE_SERIAL));
+    dispatch_source_set_timer(watchdog, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(WatchdogInterval * NSEC_PER_SEC)),
+                              (uint64_t)(WatchdogInterval * NSEC_PER_SEC), (uint64_t)(WatchdogInterval * NSEC_PER_SEC / 10));
+    __weak HTTPLoad* weakSelf = self;
+    dispatch_source_set_event_handler(watchdog, ^(void)
+                                      {
+                                          [weakSelf checkDeadline];
+                                      });
+    dispatch_resume(watchdog);
+
+    [queue addOperationWithBlock: ^(void)
+     {
+         [self connect];
+     }];
+    dispatch_semaphore_wait(done, DISPATCH_TIME_FOREVER);
+    dispatch_source_cancel(watchdog);
+
+    if (failure)
+    {
+        if (error)
+            *error = failure;
+        return nil;
+    }
+    return output;
+}
+
+
+/// Start a request for the rest of the body (or all of it, the first time)
+- (void) connect
+{
+    // The connect deadline is checked by the watchdog; the request's own timeout is a backstop
+    NSMutableURLRequest* request = [NSMutableURLRequest requestWithURL: url
+                                                           cachePolicy: NSURLRequestUseProtocolCachePolicy
+                                                       timeoutInterval: MAX(connectTimeout, readTimeout)];
+    if (received)
+    {
+        // Ask for just the part we don't have, as long as it is still the same body
+        [request setCachePolicy: NSURLRequestReloadIgnoringLocalCacheData];
+        [request setValue: [NSString stringWithFormat: @"bytes=%lld-", received]
+       forHTTPHeaderField: @"Range"];
+        [request setValue: validator
+       forHTTPHeaderField: @"If-Range"];
+    }
+
+    responded    = NO;
+    lastActivity = queuedAt ? queuedAt : CFAbsoluteTimeGetCurrent();
+    queuedAt     = 0;
+    connection   = [[NSURLConnection alloc] initWithRequest: request
+                                                   delegate: self
+                                           startImmediately: NO];
+    if (!connection)
+    {
+        // Nothing will call us back, so we are done now
+        failure = [NSError errorWithDomain: NSURLErrorDomain
+                                      code: NSURLErrorBadURL
+                                  userInfo: @{NSLocalizedDescriptionKey  : @"Couldn't make a connection for the URL.",
+                                              NSURLErrorFailingURLErrorKey: url}];
+        dispatch_semaphore_signal(done);
+        return;
+    }
+    [connection setDelegateQueue: queue];
+    [connection start];
+}
+
+
+/// The load is done; pass along the result
+- (void) finish: (NSError*) e
+{
+    if (!connection)
+        return;
+    [connection cancel];
+    connection = nil;
+    failure = e;
+    dispatch_semaphore_signal(done);
+}
+
+
+/// The connection failed or stalled; resume the download if we can, otherwise give up
+- (void) failed: (NSError*) e
+{
+    if (!connection)
+        return;
+    if (resumable && received && resumesLeft)
+    {
+        resumesLeft--;
+        [connection cancel];
+        [self connect];
+        return;
+    }
+    [self finish: e];
+}
+
+
+/// Called by the watchdog; gives up on a server that has gone quiet
+- (void) checkDeadline
+{
+    [queue addOperationWithBlock: ^(void)
+     {
+         NSTimeInterval limit = responded ? readTimeout : connectTimeout;
+         if (!connection || CFAbsoluteTimeGetCurrent() - lastActivity < limit)
+             return;
+         [self failed: [NSError errorWithDomain: NSURLErrorDomain
+                                           code: NSURLErrorTimedOut
+                                       userInfo: @{NSLocalizedDescriptionKey  : @"The server stopped responding.",
+                                                   NSURLErrorFailingURLErrorKey: url}]];
+     }];
+}
+
+
+#pragma mark NSURLConnection delegate methods
+// Each of these ignores messages from a connection that has been cancelled (eg to resume the
+// download) but had already queued them
+
+- (void) connection: (NSURLConnection*) aConnection
+ didReceiveResponse: (NSURLResponse*) response
+{
+    if (aConnection != connection)
+        return;
+    lastActivity = CFAbsoluteTimeGetCurrent();
+    responded = YES;
+    if (![response isKindOfClass: [NSHTTPURLResponse class]])
+        return;
+    NSInteger status = [(NSHTTPURLResponse*) response statusCode];
+    NSDictionary* headers = [(NSHTTPURLResponse*) response allHeaderFields];
+
+    if (received)
+    {
+        // A resume must pick up exactly where we left off
+        NSString* range = Header(headers, @"Content-Range");
+        if (206 == status && [range hasPrefix: [NSString stringWithFormat: @"bytes %lld-", received]])
+            return;
+        // The server may send the whole body again (eg it changed); if so, start over
+        if (200 != status)
+        {
+            [self finish: [NSError errorWithDomain: NSURLErrorDomain
+                                              code: NSURLErrorBadServerResponse
+                                          userInfo: @{NSLocalizedDescriptionKey  : @"The server couldn't resume the download.",
+                                                      NSURLErrorFailingURLErrorKey: url}]];
+            return;
+        }
+        received = 0;
+    }
+
+    if (status >= 300)
+    {
+        NSString* reason = [NSString stringWithFormat: @"The server responded %ld (%@).", (long) status,
+                            [NSHTTPURLResponse localizedStringForStatusCode: status]];
+        [self finish: [NSError errorWithDomain: NSURLErrorDomain
+                                          code: NSURLErrorBadServerResponse
+                                      userInfo: @{NSLocalizedDescriptionKey  : reason,
+                                                  NSURLErrorFailingURLErrorKey: url}]];
+        return;
+    }
+
+    // The system undoes a Content-Encoding before we see the body, which would throw off the
+    // byte count for a Range request; so only resume bodies that weren't encoded
+    NSString* encoding = Header(headers, @"Content-Encoding");
+    validator = Header(headers, @"ETag");
+    if ([validator hasPrefix: @"W/"])
+        validator = nil;
+    if (!validator)
+        validator = Header(headers, @"Last-Modified");
+    resumable = validator && [@"bytes" isEqualToString: Header(headers, @"Accept-Ranges")]
+                && (!encoding || [@"identity" isEqualToString: encoding]);
+    // For the same reason the encoding isn't passed along: a "deflate" body has already been
+    // inflated, and the decoder would look for a zlib header in the text.  The body is only
+    // decompressed if it is still compressed (eg a .gz file), which its first bytes tell
+    decoder = [[StreamDecoder alloc] initWithContentEncoding: nil];
+    output  = [[NSMutableData alloc] init];
+}
+
+
+- (void) connection: (NSURLConnection*) aConnection
+     didReceiveData: (NSData*) data
+{
+    if (aConnection != connection)
+        return;
+    lastActivity = CFAbsoluteTimeGetCurrent();
+    received += [data length];
+    if (!decoder)
+    {
+        decoder = [[StreamDecoder alloc] initWithContentEncoding: nil];
+        output  = [[NSMutableData alloc] init];
+    }
+    NSError* e = nil;
+    NSData* decoded = [decoder decode: data
+                                error: &e];
+    if (!decoded)
+    {
+        [self finish: e];
+        return;
+    }
+    [output appendData: decoded];
+}
+
+
+- (void) connectionDidFinishLoading: (NSURLConnection*) aConnection
+{
+    if (aConnection != connection)
+        return;
+    NSError* e = nil;
+    NSData* rest = [decoder finish: &e];
+    if (rest)
+        [output appendData: rest];
+    else if (!decoder)
+        output = [[NSMutableData alloc] init];
+    [self finish: e];
+}
+
+
+- (void) connection: (NSURLConnection*) aConnection
+   didFailWithError: (NSError*) e
+{
+    if (aConnection != connection)
+        return;
+    [self failed: e];
+}
+
+
+/// Don't keep the responses in the cache; the patches only load them once
+- (NSCachedURLResponse*) connection: (NSURLConnection*) aConnection
+                  willCacheResponse: (NSCachedURLResponse*) cachedResponse
+{
+    return nil;
+}
+
+@end
+
+
+
+@implementation HTTPLoader
+{
+    /// The semaphores that limit the loads in flight to each host.  The key is the host and port
+    NSMutableDictionary* hostSlots;
+}
+
+/// This gets the single instance that the patches share
++ (instancetype) sharedLoader
+{
+    // Hold the global instance
+    static HTTPLoader* _loader= nil;
+    static dispatch_once_t once;
+
+    // Allocate the shared instance; patches may ask for it from several threads at once
+    dispatch_once(&once, ^(void)
+                  {
+                      _loader = [[HTTPLoader alloc] init];
+                  });
+
+    // Return the shared instance
+    return _loader;
+}
+
+- (id) init
+{
+    // Tradition: initialize in the base
+    if (!(self = [super init]))
+        return self;
+    _connectTimeout        = 15.0;
+    _readTimeout           = 30.0;
+    _maxConnectionsPerHost = 4;
+    _maxResumes            = 3;
+    hostSlots              = [[NSMutableDictionary alloc] init];
+    return self;
+}
+
+
+- (NSString*) hostKeyForURL: (NSURL*) url
+{
+    // Fill in the default port, so that http://h/ and http://h:80/ are the same host
+    NSString* scheme = [[url scheme] lowercaseString];
+    NSNumber* port = [url port];
+    if ([@"http" isEqualToString: scheme])
+        port = port ? port : @80;
+    else if ([@"https" isEqualToString: scheme])
+        port = port ? port : @443;
+    else
+        return nil;
+    return [NSString stringWithFormat: @"%@:%@", [[url host] lowercaseString], port];
+}
+
+
+/// Get the semaphore that limits the loads in flight to the URL's host
+- (dispatch_semaphore_t) slotsForURL: (NSURL*) url
+{
+    NSString* host = [self hostKeyForURL: url];
+    @synchronized(hostSlots)
+    {
+        dispatch_semaphore_t slots = hostSlots[host];
+        if (!slots)
+            hostSlots[host] = slots = dispatch_semaphore_create(_maxConnectionsPerHost);
+        return slots;
+    }
+}
+
+
+- (NSData*) dataWithContentsOfURL: (NSURL*) url
+                            error: (NSError**) error
+{
+    // Leave anything that isn't HTTP to the system
+    if (![self hostKeyForURL: url])
+    {
+        NSData* data = [NSData dataWithContentsOfURL: url
+                                             options: 0
+                                               error: error];
+        if (!data)
+            return nil;
+        return [StreamDecoder decodeData: data
+                         contentEncoding: nil
+                                   error: error];
+    }
+
+    // Wait our turn for the host, but no longer than it would wait for the server to respond
+    dispatch_semaphore_t slots = [self slotsForURL: url];
+    CFAbsoluteTime queuedAt = CFAbsoluteTimeGetCurrent();
+    if (dispatch_semaphore_wait(slots, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(_connectTimeout * NSEC_PER_SEC))))
+    {
+        if (error)
+            *error = [NSError errorWithDomain: NSURLErrorDomain
+                                         code: NSURLErrorTimedOut
+                                     userInfo: @{NSLocalizedDescriptionKey  : @"Too many other loads from the server were in the way.",
+                                                 NSURLErrorFailingURLErrorKey: url}];
+        return nil;
+    }
+    HTTPLoad* load = [[HTTPLoad alloc] initWithURL: url
+                                            loader: self
+                                          queuedAt: queuedAt];
+    NSData* data = [load run: error];
+    dispatch_semaphore_signal(slots);
+    return data;
+}
+
+@end
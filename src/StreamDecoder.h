@@ -0,0 +1,88 @@
+//
+//  StreamDecoder.h
+//  QC Utilities
+//
+//  Created by Randall Maas on 10/19/26.
+/*
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+ 
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+ 
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+
+#import <Foundation/Foundation.h>
+
+/** This is a class to decompress data a chunk at a time, as it arrives.
+    The format is detected from the first bytes of the data:
+    - gzip (including several gzip members one after the other)
+    - zstd, if built with HAVE_ZSTD defined (and linked with libzstd)
+    - zlib ("deflate"), but only if the content encoding says so; its header is too easily
+      mistaken for text otherwise
+    Anything else is passed through unchanged.  Don't pass the Content-Encoding of a body that the
+    system has already decompressed (as NSURLConnection does): with "deflate", text that happens
+    to start like a zlib header would be taken as corrupt compressed data.
+ */
+@interface StreamDecoder : NSObject
+
+/** Create a decoder
+    @param encoding  The Content-Encoding of the data, if known; otherwise nil
+ */
+- (instancetype) initWithContentEncoding: (NSString*) encoding;
+
+/** Decompress the next chunk of data
+    @param chunk  The next bytes of the compressed data
+    @param error  Where to put the reason, if the data can't be decompressed
+    @returns The decompressed bytes (which may be empty); nil on error
+ */
+- (NSData*) decode: (NSData*) chunk
+             error: (NSError**) error;
+
+/** Finish decompressing; call after the last chunk
+    @param error  Where to put the reason, if the data was cut short
+    @returns Any remaining decompressed bytes; nil on error
+ */
+- (NSData*) finish: (NSError**) error;
+
+/** Decompress data that is already in memory, if it is compressed
+    @param data      The data to decompress
+    @param encoding  The Content-Encoding of the data, if known; otherwise nil
+    @param error     Where to put the reason, if the data can't be decompressed
+    @returns The decompressed data; nil on error
+ */
++ (NSData*) decodeData: (NSData*) data
+       contentEncoding: (NSString*) encoding
+                 error: (NSError**) error;
+
+/** Load a local file, decompressing it if it is compressed.
+    The file is read with Grand Central Dispatch I/O, so the next chunk is being read while the
+    previous one is being decompressed; the whole compressed file is never held in memory.
+    This blocks until the file is loaded, so don't call it on the main queue.
+    @param path   The path to the file
+    @param error  Where to put the reason, if the file can't be read or decompressed
+    @returns The decompressed contents of the file; nil on error
+ */
++ (NSData*) dataWithContentsOfFile: (NSString*) path
+                             error: (NSError**) error;
+
+/** Tell whether an error from dataWithContentsOfFile:error: means that the file couldn't be opened
+    or read (eg it doesn't exist), rather than that it was read but couldn't be decompressed
+    @param error  The error
+    @returns true if the file couldn't be opened or read
+ */
++ (BOOL) isReadError: (NSError*) error;
+
+@end
@@ -0,0 +1,376 @@
+//
+//  StreamDecoder.m
+//  QC Utilities
+//
+//  Created by Randall Maas on 10/19/26.
+/*
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+ 
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+ 
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+
+#import "StreamDecoder.h"
+#import <zlib.h>
+#ifdef HAVE_ZSTD
+#import <zstd.h>
+#endif
+
+/// The size of the buffer that the decompressed bytes are put into
+#define DecodeBufferSize (64*1024)
+/// The most bytes that the file reader hands over to be decompressed at a time
+#define ReadChunkSize (256*1024)
+/// The number of bytes needed to tell what the format is
+#define MagicSize 4
+
+/// The formats of compressed data
+typedef enum
+{
+    FormatUnknown,  ///< Not enough bytes have arrived to tell yet
+    FormatNone,     ///< Not compressed; passed through
+    FormatZlib,     ///< gzip or zlib
+    FormatZstd      ///< zstd
+} StreamFormat;
+
+@implementation StreamDecoder
+{
+    /// The format of the data, once known
+    StreamFormat format;
+    /// True if the content encoding says the data is zlib ("deflate")
+    BOOL deflate;
+    /// The first few bytes, held until there are enough to tell the format
+    NSMutableData* head;
+    /// The buffer that the decompressed bytes are put into
+    NSMutableData* buffer;
+    /// The zlib decompressor
+    z_stream zs;
+    /// True once the last zlib or zstd frame has been completely decompressed
+    BOOL ended;
+#ifdef HAVE_ZSTD
+    /// The zstd decompressor
+    ZSTD_DStream* zstd;
+#endif
+}
+
+- (instancetype) initWithContentEncoding: (NSString*) encoding
+{
+    // Tradition: initialize in the base
+    if (!(self = [super init]))
+        return self;
+    deflate = [@"deflate" isEqualToString: [encoding lowercaseString]];
+    head    = [[NSMutableData alloc] init];
+    return self;
+}
+
+- (void) dealloc
+{
+    if (FormatZlib == format)
+        inflateEnd(&zs);
+#ifdef HAVE_ZSTD
+    if (zstd)
+        ZSTD_freeDStream(zstd);
+#endif
+}
+
+
+/// Make the error for when the data can't be decompressed
+static NSError* DecodeError(NSString* reason)
+{
+    return [NSError errorWithDomain: NSCocoaErrorDomain
+                               code: NSFileReadCorruptFileError
+                           userInfo: @{NSLocalizedDescriptionKey       : @"The compressed data couldn't be decompressed.",
+                                       NSLocalizedFailureReasonErrorKey: reason}];
+}
+
+
+/** Look at the first bytes to tell the format, and set up the decompressor for it
+    @returns false if the decompressor couldn't be set up
+ */
+- (BOOL) detect: (NSError**) error
+{
+    const uint8_t* bytes = [head bytes];
+    NSUInteger length = [head length];
+    format = FormatNone;
+    if (length < 2)
+        return YES;
+
+    if ((0x1f == bytes[0] && 0x8b == bytes[1])
+        // A zlib header is a deflate method byte, with a check value that makes it a multiple of 31
+        || (deflate && 8 == (bytes[0] & 0x0f) && !(((bytes[0] << 8) | bytes[1]) % 31)))
+    {
+        // Let zlib tell gzip from zlib
+        if (Z_OK != inflateInit2(&zs, 15 + 32))
+        {
+            if (error)
+                *error = DecodeError(@"Couldn't start zlib.");
+            return NO;
+        }
+        format = FormatZlib;
+        return YES;
+    }
+
+    if (length >= MagicSize && 0x28 == bytes[0] && 0xb5 == bytes[1] && 0x2f == bytes[2] && 0xfd == bytes[3])
+    {
+#ifdef HAVE_ZSTD
+        zstd = ZSTD_createDStream();
+        if (zstd && !ZSTD_isError(ZSTD_initDStream(zstd)))
+        {
+            format = FormatZstd;
+            return YES;
+        }
+        if (error)
+            *error = DecodeError(@"Couldn't start zstd.");
+#else
+        if (error)
+            *error = DecodeError(@"The data is zstd compressed, and zstd support was not built in.");
+#endif
+        return NO;
+    }
+    return YES;
+}
+
+
+/// Decompress the next chunk with zlib
+- (NSData*) inflate: (NSData*) chunk
+              error: (NSError**) error
+{
+    NSMutableData* output = [[NSMutableData alloc] init];
+    zs.next_in  = (Bytef*) [chunk bytes];
+    zs.avail_in = (uInt) [chunk length];
+    do
+    {
+        zs.next_out = [buffer mutableBytes];
+        zs.avail_out= DecodeBufferSize;
+        int ret = inflate(&zs, Z_NO_FLUSH);
+        [output appendBytes: [buffer bytes]
+                     length: DecodeBufferSize - zs.avail_out];
+        if (Z_STREAM_END == ret)
+        {
+            ended = YES;
+            if (!zs.avail_in)
+                break;
+            // Another gzip member follows this one
+            inflateReset(&zs);
+            ended = NO;
+            continue;
+        }
+        // Ran out of input exactly as the buffer filled up
+        if (Z_BUF_ERROR == ret)
+            break;
+        if (Z_OK != ret)
+        {
+            if (error)
+                *error = DecodeError(zs.msg ? @(zs.msg) : @"The compressed data is corrupt.");
+            return nil;
+        }
+    } while (zs.avail_in || !zs.avail_out);
+    return output;
+}
+
+
+#ifdef HAVE_ZSTD
+/// Decompress the next chunk with zstd
+- (NSData*) zstd: (NSData*) chunk
+           error: (NSError**) error
+{
+    NSMutableData* output = [[NSMutableData alloc] init];
+    ZSTD_inBuffer in = {[chunk bytes], [chunk length], 0};
+    for (;;)
+    {
+        ZSTD_outBuffer out = {[buffer mutableBytes], DecodeBufferSize, 0};
+        size_t ret = ZSTD_decompressStream(zstd, &out, &in);
+        if (ZSTD_isError(ret))
+        {
+            if (error)
+                *error = DecodeError(@(ZSTD_getErrorName(ret)));
+            return nil;
+        }
+        [output appendBytes: [buffer bytes]
+                     length: out.pos];
+        // Zero means that a frame was completely decompressed
+        ended = !ret;
+        // Done once all of the input is used and zstd has nothing more to give
+        if (in.pos == in.size && out.pos < out.size)
+            break;
+    }
+    return output;
+}
+#endif
+
+
+- (NSData*) decode: (NSData*) chunk
+             error: (NSError**) error
+{
+    if (FormatUnknown == format)
+    {
+        // Hold the first bytes until there are enough to tell the format
+        [head appendData: chunk];
+        if ([head length] < MagicSize)
+            return [NSData data];
+        if (![self detect: error])
+            return nil;
+        chunk = head;
+        head = nil;
+    }
+
+    if (FormatNone == format)
+        return chunk;
+    if (!buffer)
+        buffer = [[NSMutableData alloc] initWithLength: DecodeBufferSize];
+#ifdef HAVE_ZSTD
+    if (FormatZstd == format)
+        return [self zstd: chunk error: error];
+#endif
+    return [self inflate: chunk error: error];
+}
+
+
+- (NSData*) finish: (NSError**) error
+{
+    // Anything too short to tell the format is passed through
+    if (FormatUnknown == format)
+    {
+        format = FormatNone;
+        NSData* rest = head;
+        head = nil;
+        return rest;
+    }
+    if (FormatNone != format && !ended)
+    {
+        if (error)
+            *error = DecodeError(@"The compressed data ended early.");
+        return nil;
+    }
+    return [NSData data];
+}
+
+
++ (NSData*) decodeData: (NSData*) data
+       contentEncoding: (NSString*) encoding
+                 error: (NSError**) error
+{
+    StreamDecoder* decoder = [[StreamDecoder alloc] initWithContentEncoding: encoding];
+    NSData* decoded = [decoder decode: data
+                                error: error];
+    if (!decoded)
+        return nil;
+    NSData* rest = [decoder finish: error];
+    if (!rest)
+        return nil;
+    // Most data isn't compressed; don't copy it when it isn't
+    if (![rest length])
+        return decoded;
+    NSMutableData* output = [decoded mutableCopy];
+    [output appendData: rest];
+    return output;
+}
+
+
++ (NSData*) dataWithContentsOfFile: (NSString*) path
+                             error: (NSError**) error
+{
+    // GCD I/O needs an absolute path
+    path = [[NSURL fileURLWithPath: path] path];
+
+    // The chunks are decompressed, in order, on this queue while GCD reads the next ones.  It is
+    // left as a private queue so that it gets a thread even when the caller, and others like it,
+    // have tied up all of the global queue threads waiting on loads like this one
+    dispatch_queue_t queue = dispatch_queue_create("QCUtils.StreamDecoder", DISPATCH_QUEUE_SERIAL);
+    dispatch_io_t channel = dispatch_io_create_with_path(DISPATCH_IO_STREAM, [path fileSystemRepresentation],
+                                                         O_RDONLY, 0, queue, ^(int err){});
+    if (!channel)
+    {
+        if (error)
+            *error = [NSError errorWithDomain: NSPOSIXErrorDomain
+                                         code: errno
+                                     userInfo: @{NSFilePathErrorKey: path}];
+        return nil;
+    }
+    // Hand over bounded chunks, rather than the whole file at the end
+    dispatch_io_set_high_water(channel, ReadChunkSize);
+
+    StreamDecoder* decoder = [[StreamDecoder alloc] initWithContentEncoding: nil];
+    NSMutableData* output = [[NSMutableData alloc] init];
+    __block NSError* failure = nil;
+    dispatch_semaphore_t done = dispatch_semaphore_create(0);
+    dispatch_io_read(channel, 0, SIZE_MAX, queue, ^(bool finished, dispatch_data_t data, int err)
+                     {
+                         if (failure)
+                             return;
+                         @autoreleasepool
+                         {
+                             __block NSError* e = nil;
+                             // Decompress each piece of what was read
+                             if (data)
+                                 dispatch_data_apply(data, ^bool(dispatch_data_t region, size_t offset, const void* bytes, size_t size)
+                                                     {
+                                                         NSError* pieceError = nil;
+                                                         NSData* decoded = [decoder decode: [NSData dataWithBytesNoCopy: (void*) bytes
+                                                                                                                 length: size
+                                                                                                           freeWhenDone: NO]
+                                                                                     error: &pieceError];
+                                                         if (!decoded)
+                                                         {
+                                                             e = pieceError;
+                                                             return false;
+                                                         }
+                                                         [output appendData: decoded];
+                                                         return true;
+                                                     });
+                             if (!e && err)
+                                 e = [NSError errorWithDomain: NSPOSIXErrorDomain
+                                                         code: err
+                                                     userInfo: @{NSFilePathErrorKey: path}];
+                             if (!e && finished)
+                             {
+                                 NSError* finishError = nil;
+                                 NSData* rest = [decoder finish: &finishError];
+                                 if (rest)
+                                     [output appendData: rest];
+                                 e = finishError;
+                             }
+                             if (e)
+                             {
+                                 failure = e;
+                                 dispatch_io_close(channel, DISPATCH_IO_STOP);
+                             }
+                             if (finished || e)
+                                 dispatch_semaphore_signal(done);
+                         }
+                     });
+    dispatch_semaphore_wait(done, DISPATCH_TIME_FOREVER);
+    dispatch_io_close(channel, 0);
+
+    if (failure)
+    {
+        if (error)
+            *error = failure;
+        return nil;
+    }
+    return output;
+}
+
+
++ (BOOL) isReadError: (NSError*) error
+{
+    // The errors from opening and reading the file are POSIX errors; ours are Cocoa ones
+    return [NSPOSIXErrorDomain isEqualToString: [error domain]]
+        || ([NSCocoaErrorDomain isEqualToString: [error domain]] && NSFileReadCorruptFileError != [error code]
+            && [error code] >= NSFileReadErrorMinimum && [error code] <= NSFileReadErrorMaximum);
+}
+
+@end
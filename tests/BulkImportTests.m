@@ -0,0 +1,182 @@
+//
+//  BulkImportTests.m
+//  QC Utilities
+//
+//  Created by Randall Maas on 10/19/26.
+/*
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+/*
+ A benchmark of loading many small files the way the Bulk Importer does, against loading them the
+ way that many String Importer patches would.  Build and run from the top of the repository with:
+
+    clang -fobjc-arc -framework Foundation -framework Quartz -framework ExceptionHandling -lz tests/BulkImportTests.m StringImport.m Error2Structure.m ExceptionUnhandled.m src/StreamDecoder.m src/HTTPLoader.m src/FileTail.m -o /tmp/BulkImportTests && /tmp/BulkImportTests
+
+ It writes a folder of small JSON files (500 unless another count is given as the argument), and
+ loads them all with +[StringImport stringWithContentsOfPath:error:]:
+ - one at a time
+ - each on the global queue, all at once, as one String Importer patch per file does
+ - on 8 and on 32 private serial queues ("lanes"), as the Bulk Importer does with 'max loads'
+ It prints PASS or FAIL for whether each way loaded every file, the time each took, and exits
+ with 1 if any failed.  The files were just written, so they are read from the file cache; this
+ measures the overhead of the loads, not the disk.
+ */
+
+#import <Foundation/Foundation.h>
+#import "../StringImport.h"
+
+/// How many times to run each way of loading; the fastest is reported
+#define Runs 3
+
+
+#pragma mark Helpers
+
+/// The number of checks that failed
+static int failures = 0;
+
+/// Report a check
+static void Check(BOOL ok, NSString* name)
+{
+    printf("%s %s\n", ok ? "PASS" : "FAIL", [name UTF8String]);
+    if (!ok)
+        failures++;
+}
+
+
+/// Write a folder of small JSON files, and return their paths
+static NSArray* WriteFiles(NSString* folder, NSUInteger count)
+{
+    [[NSFileManager defaultManager] removeItemAtPath: folder error: NULL];
+    [[NSFileManager defaultManager] createDirectoryAtPath: folder withIntermediateDirectories: YES attributes: nil error: NULL];
+    NSMutableArray* paths = [[NSMutableArray alloc] init];
+    for (NSUInteger I = 0; I < count; I++)
+    {
+        NSMutableString* json = [NSMutableString stringWithFormat: @"{\"id\": %lu, \"items\": [", (unsigned long) I];
+        for (NSUInteger J = 0; J < 40; J++)
+            [json appendFormat: @"%@{\"name\": \"item %lu\", \"value\": %lu}", J ? @", " : @"", (unsigned long) J, (unsigned long)(I * J)];
+        [json appendString: @"]}\n"];
+        NSString* path = [folder stringByAppendingPathComponent: [NSString stringWithFormat: @"%04lu.json", (unsigned long) I]];
+        [json writeToFile: path atomically: NO encoding: NSUTF8StringEncoding error: NULL];
+        [paths addObject: path];
+    }
+    return paths;
+}
+
+
+/** Load a file, and count it if it loaded
+    @param path    The file to load
+    @param loaded  The count of files loaded
+ */
+static void Load(NSString* path, volatile int32_t* loaded)
+{
+    @autoreleasepool
+    {
+        NSError* e = nil;
+        if ([StringImport stringWithContentsOfPath: path error: &e])
+            __sync_fetch_and_add(loaded, 1);
+    }
+}
+
+
+#pragma mark Ways to load
+
+/// Load the files one at a time
+static int32_t LoadSerially(NSArray* paths)
+{
+    volatile int32_t loaded = 0;
+    for (NSString* path in paths)
+        Load(path, &loaded);
+    return loaded;
+}
+
+
+/// Load each file on the global queue, all at once, the way one String Importer per file does
+static int32_t LoadPerInstance(NSArray* paths)
+{
+    __block volatile int32_t loaded = 0;
+    dispatch_group_t group = dispatch_group_create();
+    for (NSString* path in paths)
+        dispatch_group_async(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(void)
+                             {
+                                 Load(path, &loaded);
+                             });
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    return loaded;
+}
+
+
+/// Load the files on private serial queues, each taking the next waiting file when it is free,
+/// the way the Bulk Importer does
+static int32_t LoadInLanes(NSArray* paths, NSUInteger lanes)
+{
+    __block volatile int32_t loaded = 0;
+    __block volatile int32_t next = 0;
+    dispatch_group_t group = dispatch_group_create();
+    for (NSUInteger I = 0; I < lanes; I++)
+        dispatch_group_async(group, dispatch_queue_create("BulkImportTests.lane", DISPATCH_QUEUE_SERIAL), ^(void)
+                             {
+                                 int32_t index;
+                                 while ((index = __sync_fetch_and_add(&next, 1)) < (int32_t)[paths count])
+                                     Load(paths[index], &loaded);
+                             });
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    return loaded;
+}
+
+
+/** Time a way of loading the files, and check that it loaded all of them
+    @param name   What to call the way of loading
+    @param paths  The files to load
+    @param load   Loads the files, and returns how many loaded
+ */
+static void Bench(NSString* name, NSArray* paths, int32_t (^load)(void))
+{
+    NSTimeInterval best = 0;
+    BOOL all = YES;
+    for (int run = 0; run < Runs; run++)
+    {
+        NSDate* start = [NSDate date];
+        int32_t loaded = load();
+        NSTimeInterval elapsed = -[start timeIntervalSinceNow];
+        all = all && loaded == (int32_t)[paths count];
+        if (!run || elapsed < best)
+            best = elapsed;
+    }
+    Check(all, [NSString stringWithFormat: @"%@ loads every file", name]);
+    printf("%-28s %8.1f ms  %8.0f files/s\n", [name UTF8String], best * 1000, [paths count] / best);
+}
+
+
+int main(int argc, const char* argv[])
+{
+    @autoreleasepool
+    {
+        NSUInteger count = argc > 1 ? (NSUInteger) atoi(argv[1]) : 500;
+        NSString* folder = [NSTemporaryDirectory() stringByAppendingPathComponent: @"BulkImportTests"];
+        NSArray* paths = WriteFiles(folder, count);
+
+        Bench(@"one at a time", paths, ^int32_t{ return LoadSerially(paths); });
+        Bench(@"one patch per file", paths, ^int32_t{ return LoadPerInstance(paths); });
+        Bench(@"8 lanes", paths, ^int32_t{ return LoadInLanes(paths, 8); });
+        Bench(@"32 lanes", paths, ^int32_t{ return LoadInLanes(paths, 32); });
+        [[NSFileManager defaultManager] removeItemAtPath: folder error: NULL];
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,339 @@
+//
+//  FileTailTests.m
+//  QC Utilities
+//
+//  Created by Randall Maas on 10/19/26.
+/*
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+/*
+ Tests and a benchmark for FileTail.  Build and run from the top of the repository with:
+
+    clang -fobjc-arc -framework Foundation tests/FileTailTests.m src/FileTail.m -o /tmp/FileTailTests && /tmp/FileTailTests
+
+ It prints PASS or FAIL for each check, and exits with 1 if any failed.  Then it follows a file
+ that another process (this program, run with --write) appends time stamped lines to at a fixed
+ rate, and reports the time from each write to the handler seeing it, and the CPU time that
+ following the file took.  The writer is a separate process so that its CPU time isn't counted.
+ */
+
+#import <Foundation/Foundation.h>
+#import <sys/resource.h>
+#import <fcntl.h>
+#import <unistd.h>
+#import "../src/FileTail.h"
+
+/// How long each benchmark run writes for, in seconds
+#define BenchSeconds 3
+
+
+#pragma mark Helpers
+
+/// The number of checks that failed
+static int failures = 0;
+
+/// Report a check
+static void Check(BOOL ok, NSString* name)
+{
+    printf("%s %s\n", ok ? "PASS" : "FAIL", [name UTF8String]);
+    if (!ok)
+        failures++;
+}
+
+
+/// Wait, up to the timeout, for the test to be true
+static BOOL WaitFor(NSTimeInterval timeout, BOOL (^test)(void))
+{
+    NSDate* end = [NSDate dateWithTimeIntervalSinceNow: timeout];
+    while (!test())
+    {
+        if ([end timeIntervalSinceNow] < 0)
+            return NO;
+        usleep(10000);
+    }
+    return YES;
+}
+
+
+/// Append the text to the file
+static void Append(NSString* path, NSString* text)
+{
+    int fd = open([path fileSystemRepresentation], O_WRONLY | O_APPEND | O_CREAT, 0644);
+    NSData* data = [text dataUsingEncoding: NSUTF8StringEncoding];
+    write(fd, [data bytes], [data length]);
+    close(fd);
+}
+
+
+/// The CPU time (user and system) that this process has used so far, in seconds
+static double CPUTime(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+         + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+
+/** This collects what a FileTail passes to its handler.  The handler runs on the FileTail's
+    queue, and the tests look at it from the main thread, so it is locked.
+ */
+@interface Collector : NSObject
+- (FileTailHandler) handler;
+/// Everything passed along since the last reset
+@property(readonly) NSData* data;
+/// The number of times the handler was told to reset
+@property(readonly) NSUInteger resets;
+@end
+
+@implementation Collector
+{
+    NSMutableData* _data;
+    NSUInteger _resets;
+}
+
+- (instancetype) init
+{
+    // Tradition: initialize in the base
+    if (!(self = [super init]))
+        return self;
+    _data = [[NSMutableData alloc] init];
+    return self;
+}
+
+- (FileTailHandler) handler
+{
+    return ^(FileTail* tail, NSData* data, BOOL reset, NSError* error)
+    {
+        @synchronized(self)
+        {
+            if (reset)
+            {
+                _resets++;
+                [_data setLength: 0];
+            }
+            if (data)
+                [_data appendData: data];
+        }
+    };
+}
+
+- (NSData*) data
+{
+    @synchronized(self)
+    {
+        return [_data copy];
+    }
+}
+
+- (NSUInteger) resets
+{
+    @synchronized(self)
+    {
+        return _resets;
+    }
+}
+@end
+
+
+#pragma mark Tests
+
+/// What is in the file, and what is appended, is passed along once and in order
+static void TestAppend(NSString* path)
+{
+    [[NSFileManager defaultManager] removeItemAtPath: path error: NULL];
+    Append(path, @"hello\n");
+    Collector* collector = [[Collector alloc] init];
+    FileTail* tail = [[FileTail alloc] initWithPath: path handler: [collector handler]];
+    [tail start];
+
+    NSData* expected = [@"hello\n" dataUsingEncoding: NSUTF8StringEncoding];
+    Check(WaitFor(2.0, ^BOOL{ return [collector.data isEqualToData: expected]; }), @"the file's contents are passed along");
+    Append(path, @"one\n");
+    Append(path, @"two\n");
+    expected = [@"hello\none\ntwo\n" dataUsingEncoding: NSUTF8StringEncoding];
+    Check(WaitFor(2.0, ^BOOL{ return [collector.data isEqualToData: expected]; }), @"appended text is passed along once, in order");
+
+    // Truncate and rewrite it, the way copytruncate log rotation does
+    NSUInteger resets = collector.resets;
+    truncate([path fileSystemRepresentation], 0);
+    Append(path, @"new\n");
+    expected = [@"new\n" dataUsingEncoding: NSUTF8StringEncoding];
+    Check(WaitFor(2.0, ^BOOL{ return collector.resets > resets && [collector.data isEqualToData: expected]; }), @"a truncated file is read again from the start");
+
+    // Replace it, the way rename log rotation does
+    resets = collector.resets;
+    NSString* rotated = [path stringByAppendingString: @".1"];
+    [[NSFileManager defaultManager] removeItemAtPath: rotated error: NULL];
+    rename([path fileSystemRepresentation], [rotated fileSystemRepresentation]);
+    Append(path, @"rotated\n");
+    expected = [@"rotated\n" dataUsingEncoding: NSUTF8StringEncoding];
+    Check(WaitFor(4.0, ^BOOL{ return collector.resets > resets && [collector.data isEqualToData: expected]; }), @"a replaced file is followed");
+
+    [tail cancel];
+    [[NSFileManager defaultManager] removeItemAtPath: rotated error: NULL];
+}
+
+
+/// Only the end of a big file is passed along
+static void TestMaxLength(NSString* path)
+{
+    [[NSFileManager defaultManager] removeItemAtPath: path error: NULL];
+    Append(path, [@"" stringByPaddingToLength: 10000 withString: @"0123456789" startingAtIndex: 0]);
+    Collector* collector = [[Collector alloc] init];
+    FileTail* tail = [[FileTail alloc] initWithPath: path handler: [collector handler]];
+    tail.maxLength = 100;
+    [tail start];
+    Check(WaitFor(2.0, ^BOOL{ return 100 == [collector.data length]; }) && collector.resets, @"only the last maxLength bytes are passed along");
+    [tail cancel];
+}
+
+
+#pragma mark Benchmark
+
+/** Append time stamped lines to the file at a fixed rate; run in its own process
+    @param path     The file to append to
+    @param rate     The lines to write a second
+    @param seconds  How long to write for
+ */
+static void Writer(NSString* path, double rate, double seconds)
+{
+    int fd = open([path fileSystemRepresentation], O_WRONLY | O_APPEND | O_CREAT, 0644);
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    unsigned long written = 0, total = (unsigned long)(rate * seconds);
+    char buffer[64*1024];
+    while (written < total)
+    {
+        // Write the lines that are due, in one write, then wait a millisecond
+        CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+        unsigned long due = MIN(total, (unsigned long)((now - start) * rate));
+        size_t length = 0;
+        while (written < due && length + 100 < sizeof buffer)
+            length += snprintf(buffer + length, sizeof buffer - length, "%.6f %lu a line of log text\n", now, written++);
+        if (length)
+            write(fd, buffer, length);
+        usleep(1000);
+    }
+    close(fd);
+}
+
+
+/// Compare two latencies, for sorting
+static int CompareDoubles(const void* a, const void* b)
+{
+    double x = *(const double*) a, y = *(const double*) b;
+    return x < y ? -1 : x > y;
+}
+
+
+/** Follow a file while another process appends to it, and report the latency and CPU time
+    @param path      The file to follow
+    @param rate      The lines a second to append
+    @param debounce  The FileTail's debounce interval
+ */
+static void Bench(NSString* path, double rate, NSTimeInterval debounce)
+{
+    [[NSFileManager defaultManager] removeItemAtPath: path error: NULL];
+    Append(path, @"");
+
+    // The handler works out the latency of each whole line, as soon as it sees it
+    unsigned long expected = (unsigned long)(rate * BenchSeconds);
+    double* latencies = calloc(expected, sizeof *latencies);
+    __block unsigned long count = 0;
+    __block unsigned long batches = 0;
+    NSMutableData* partial = [[NSMutableData alloc] init];
+    NSObject* lock = [[NSObject alloc] init];
+    FileTail* tail = [[FileTail alloc] initWithPath: path
+                                            handler: ^(FileTail* sender, NSData* data, BOOL reset, NSError* error)
+                      {
+                          CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+                          if (!data)
+                              return;
+                          [partial appendData: data];
+                          const char* bytes = [partial bytes];
+                          NSUInteger length = [partial length], used = 0;
+                          @synchronized(lock)
+                          {
+                              batches++;
+                              for (NSUInteger I = 0; I < length; I++)
+                              {
+                                  if ('\n' != bytes[I])
+                                      continue;
+                                  if (count < expected)
+                                      latencies[count++] = now - strtod(bytes + used, NULL);
+                                  used = I + 1;
+                              }
+                          }
+                          [partial replaceBytesInRange: NSMakeRange(0, used) withBytes: NULL length: 0];
+                      }];
+    tail.debounce = debounce;
+    [tail start];
+    // Give it time to open the file before writing starts
+    usleep(100000);
+
+    double cpu = CPUTime();
+    NSTask* writer = [NSTask launchedTaskWithLaunchPath: [[NSBundle mainBundle] executablePath]
+                                              arguments: @[@"--write", path, [NSString stringWithFormat: @"%g", rate],
+                                                           [NSString stringWithFormat: @"%d", BenchSeconds]]];
+    [writer waitUntilExit];
+    BOOL all = WaitFor(2.0, ^BOOL{ @synchronized(lock) { return count == expected; } });
+    cpu = CPUTime() - cpu;
+    [tail cancel];
+
+    @synchronized(lock)
+    {
+        Check(all, [NSString stringWithFormat: @"every line is seen at %g lines/s", rate]);
+        qsort(latencies, count, sizeof *latencies, CompareDoubles);
+        double mean = 0;
+        for (unsigned long I = 0; I < count; I++)
+            mean += latencies[I] / count;
+        printf("%8g lines/s  debounce %5.1f ms  latency ms: mean %6.1f  p50 %6.1f  p99 %6.1f  max %6.1f  "
+               "%6lu reads  CPU %5.1f%% of a core\n",
+               rate, debounce * 1000, mean * 1000,
+               count ? latencies[count / 2] * 1000 : 0, count ? latencies[count * 99 / 100] * 1000 : 0,
+               count ? latencies[count - 1] * 1000 : 0, batches, cpu / BenchSeconds * 100);
+    }
+    free(latencies);
+    [[NSFileManager defaultManager] removeItemAtPath: path error: NULL];
+}
+
+
+int main(int argc, const char* argv[])
+{
+    @autoreleasepool
+    {
+        // The benchmark runs this program again to do the writing
+        if (5 == argc && !strcmp(argv[1], "--write"))
+        {
+            Writer(@(argv[2]), atof(argv[3]), atof(argv[4]));
+            return 0;
+        }
+
+        NSString* path = [NSTemporaryDirectory() stringByAppendingPathComponent: @"FileTailTests.log"];
+        TestAppend(path);
+        TestMaxLength(path);
+
+        for (NSNumber* debounce in @[@0.05, @0.005])
+            for (NSNumber* rate in @[@100, @1000, @10000, @100000])
+                Bench(path, [rate doubleValue], [debounce doubleValue]);
+        [[NSFileManager defaultManager] removeItemAtPath: path error: NULL];
+    }
+    return failures ? 1 : 0;
+}
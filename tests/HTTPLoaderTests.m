@@ -0,0 +1,456 @@
+//
+//  HTTPLoaderTests.m
+//  QC Utilities
+//
+//  Created by Randall Maas on 10/19/26.
+/*
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+ 
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+ 
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+/*
+ Tests for HTTPLoader, against a stand-in HTTP server on the loopback interface that can stall
+ and drop connections.  Build and run from the top of the repository with:
+
+    clang -fobjc-arc -framework Foundation -lz tests/HTTPLoaderTests.m src/HTTPLoader.m src/StreamDecoder.m -o /tmp/HTTPLoaderTests && /tmp/HTTPLoaderTests
+
+ It prints PASS or FAIL for each check, and exits with 1 if any failed.  These haven't been run on
+ a Mac yet; the checks that depend on CFNetwork's behaviour (a body cut short of its Content-Length,
+ and the deadline timings) are the most likely to need adjusting.
+ */
+
+#import <Foundation/Foundation.h>
+#import <sys/socket.h>
+#import <netinet/in.h>
+#import <arpa/inet.h>
+#import <unistd.h>
+#import <signal.h>
+#import "../src/HTTPLoader.h"
+
+/// The size of the body that the server sends
+#define BodySize (200*1000)
+/// The ETag that the server gives the body
+#define BodyETag @"\"v1\""
+
+/** What the stand-in server does for one request
+    @param fd       The connection to write the response to; it is closed afterward
+    @param headers  The request headers; the keys are lower case
+    @param number   Which request this is, counting from zero
+ */
+typedef void (^Responder)(int fd, NSDictionary* headers, NSUInteger number);
+
+
+/** This is a minimal HTTP server on the loopback interface.  Each request is handed to a
+    responder block, which writes whatever response (or lack of one) the test needs.
+ */
+@interface StandInServer : NSObject
+- (instancetype) initWithResponder: (Responder) responder;
+- (void) stop;
+/// The URL of the server
+@property(readonly) NSURL* url;
+/// The headers of each request received so far
+@property(readonly) NSArray* requests;
+@end
+
+@implementation StandInServer
+{
+    /// What to do for each request
+    Responder responder;
+    /// The socket listening for connections
+    int listener;
+    /// The headers of each request received so far
+    NSMutableArray* _requests;
+}
+
+- (instancetype) initWithResponder: (Responder) aResponder
+{
+    // Tradition: initialize in the base
+    if (!(self = [super init]))
+        return self;
+    responder = [aResponder copy];
+    _requests = [[NSMutableArray alloc] init];
+
+    // Listen on any free port on the loopback interface
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {0};
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof addr;
+    if (bind(listener, (struct sockaddr*) &addr, length) || listen(listener, 16)
+        || getsockname(listener, (struct sockaddr*) &addr, &length))
+        return nil;
+    _url = [NSURL URLWithString: [NSString stringWithFormat: @"http://127.0.0.1:%d/body", ntohs(addr.sin_port)]];
+
+    // Each connection is handled on its own, so that a stalled one doesn't hold up the rest
+    dispatch_queue_t connections = dispatch_queue_create("StandInServer.connections", DISPATCH_QUEUE_CONCURRENT);
+    int fd = listener;
+    dispatch_async(dispatch_queue_create("StandInServer.accept", DISPATCH_QUEUE_SERIAL), ^(void)
+                   {
+                       int client;
+                       while ((client = accept(fd, NULL, NULL)) >= 0)
+                           dispatch_async(connections, ^(void)
+                                          {
+                                              [self serve: client];
+                                          });
+                   });
+    return self;
+}
+
+
+/// Stop taking connections
+- (void) stop
+{
+    shutdown(listener, SHUT_RDWR);
+    close(listener);
+}
+
+
+- (NSArray*) requests
+{
+    @synchronized(self)
+    {
+        return [_requests copy];
+    }
+}
+
+
+/// Read a request from the connection, and hand it to the responder
+- (void) serve: (int) client
+{
+    // Read up to the end of the headers
+    NSMutableData* request = [[NSMutableData alloc] init];
+    NSData* end = [@"\r\n\r\n" dataUsingEncoding: NSASCIIStringEncoding];
+    char buffer[4096];
+    while (![request length] || NSNotFound == [request rangeOfData: end options: 0 range: NSMakeRange(0, [request length])].location)
+    {
+        ssize_t count = recv(client, buffer, sizeof buffer, 0);
+        if (count <= 0)
+        {
+            close(client);
+            return;
+        }
+        [request appendBytes: buffer length: count];
+    }
+
+    // Pull out the headers
+    NSMutableDictionary* headers = [[NSMutableDictionary alloc] init];
+    NSString* text = [[NSString alloc] initWithData: request encoding: NSASCIIStringEncoding];
+    for (NSString* line in [text componentsSeparatedByString: @"\r\n"])
+    {
+        NSRange colon = [line rangeOfString: @":"];
+        if (NSNotFound == colon.location)
+            continue;
+        headers[[[line substringToIndex: colon.location] lowercaseString]] =
+            [[line substringFromIndex: NSMaxRange(colon)] stringByTrimmingCharactersInSet: [NSCharacterSet whitespaceCharacterSet]];
+    }
+
+    NSUInteger number;
+    @synchronized(self)
+    {
+        number = [_requests count];
+        [_requests addObject: headers];
+    }
+    responder(client, headers, number);
+    close(client);
+}
+
+@end
+
+
+#pragma mark Helpers
+
+/// The body that the server sends
+static NSData* Body(void)
+{
+    static NSMutableData* body = nil;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^(void)
+                  {
+                      body = [NSMutableData dataWithLength: BodySize];
+                      uint8_t* bytes = [body mutableBytes];
+                      for (NSUInteger I = 0; I < BodySize; I++)
+                          bytes[I] = (uint8_t)((I * 7) % 251);
+                  });
+    return body;
+}
+
+
+/// Write a string to the connection
+static void Send(int fd, NSString* text)
+{
+    NSData* data = [text dataUsingEncoding: NSASCIIStringEncoding];
+    send(fd, [data bytes], [data length], 0);
+}
+
+
+/// Write part of the body to the connection
+static void SendBody(int fd, NSUInteger from, NSUInteger to)
+{
+    send(fd, (const uint8_t*) [Body() bytes] + from, to - from, 0);
+}
+
+
+/// Write a 200 response for the whole body; only the first 'upTo' bytes of it are sent
+static void SendWhole(int fd, NSUInteger upTo)
+{
+    Send(fd, [NSString stringWithFormat: @"HTTP/1.1 200 OK\r\nContent-Length: %d\r\nETag: %@\r\n"
+                                         @"Accept-Ranges: bytes\r\nConnection: close\r\n\r\n", BodySize, BodyETag]);
+    SendBody(fd, 0, upTo);
+}
+
+
+/// Write a 206 response for the body from 'from'; only up to 'upTo' is sent
+static void SendRest(int fd, NSUInteger from, NSUInteger upTo)
+{
+    Send(fd, [NSString stringWithFormat: @"HTTP/1.1 206 Partial Content\r\nContent-Length: %lu\r\n"
+                                         @"Content-Range: bytes %lu-%d/%d\r\nETag: %@\r\nAccept-Ranges: bytes\r\n"
+                                         @"Connection: close\r\n\r\n",
+                                         (unsigned long)(BodySize - from), (unsigned long) from, BodySize - 1, BodySize, BodyETag]);
+    SendBody(fd, from, upTo);
+}
+
+
+/// The offset that a request asked to start from; zero if it didn't ask for a range
+static NSUInteger RangeStart(NSDictionary* headers)
+{
+    NSString* range = headers[@"range"];
+    if (![range hasPrefix: @"bytes="])
+        return 0;
+    return (NSUInteger)[[range substringFromIndex: 6] longLongValue];
+}
+
+
+/// Make a loader with short deadlines, so that the tests don't take long
+static HTTPLoader* Loader(void)
+{
+    HTTPLoader* loader = [[HTTPLoader alloc] init];
+    loader.connectTimeout = 2.0;
+    loader.readTimeout    = 2.0;
+    return loader;
+}
+
+
+/// The number of checks that failed
+static int failures = 0;
+
+/// Report the result of a check
+static void Check(BOOL ok, NSString* name)
+{
+    printf("%s %s\n", ok ? "PASS" : "FAIL", [name UTF8String]);
+    if (!ok)
+        failures++;
+}
+
+
+#pragma mark Tests
+
+/// A body that arrives in one go is passed along as is
+static void TestWhole(void)
+{
+    StandInServer* server = [[StandInServer alloc] initWithResponder: ^(int fd, NSDictionary* headers, NSUInteger number)
+                             {
+                                 SendWhole(fd, BodySize);
+                             }];
+    NSError* e = nil;
+    NSData* data = [Loader() dataWithContentsOfURL: server.url error: &e];
+    Check([data isEqualToData: Body()], @"whole body is loaded");
+    Check(1 == [server.requests count], @"whole body takes one request");
+    [server stop];
+}
+
+
+/// A connection dropped part way through is resumed from where it left off
+static void TestResumeAfterDrop(void)
+{
+    StandInServer* server = [[StandInServer alloc] initWithResponder: ^(int fd, NSDictionary* headers, NSUInteger number)
+                             {
+                                 if (!number)
+                                     SendWhole(fd, BodySize / 2);
+                                 else
+                                     SendRest(fd, RangeStart(headers), BodySize);
+                             }];
+    NSError* e = nil;
+    NSData* data = [Loader() dataWithContentsOfURL: server.url error: &e];
+    NSArray* requests = server.requests;
+    Check([data isEqualToData: Body()], @"dropped body is resumed");
+    Check(2 == [requests count], @"dropped body takes two requests");
+    if (2 == [requests count])
+    {
+        Check(RangeStart(requests[1]) == BodySize / 2, @"resume asks for the rest of the body with Range");
+        Check([BodyETag isEqualToString: requests[1][@"if-range"]], @"resume sends the ETag in If-Range");
+    }
+    [server stop];
+}
+
+
+/// A server that answers a resume with the whole body again starts over, rather than appending it
+static void TestRestartOn200(void)
+{
+    StandInServer* server = [[StandInServer alloc] initWithResponder: ^(int fd, NSDictionary* headers, NSUInteger number)
+                             {
+                                 SendWhole(fd, number ? BodySize : BodySize / 2);
+                             }];
+    NSError* e = nil;
+    NSData* data = [Loader() dataWithContentsOfURL: server.url error: &e];
+    Check([data isEqualToData: Body()], @"a 200 answer to a resume starts the body over");
+    [server stop];
+}
+
+
+/// A resume that doesn't start where we left off is an error
+static void TestWrongContentRange(void)
+{
+    StandInServer* server = [[StandInServer alloc] initWithResponder: ^(int fd, NSDictionary* headers, NSUInteger number)
+                             {
+                                 if (!number)
+                                     SendWhole(fd, BodySize / 2);
+                                 else
+                                     SendRest(fd, 0, BodySize);
+                             }];
+    NSError* e = nil;
+    NSData* data = [Loader() dataWithContentsOfURL: server.url error: &e];
+    Check(!data && NSURLErrorBadServerResponse == [e code], @"a resume at the wrong offset is an error");
+    [server stop];
+}
+
+
+/// A server that never responds is given up on at the connect deadline
+static void TestConnectStall(void)
+{
+    StandInServer* server = [[StandInServer alloc] initWithResponder: ^(int fd, NSDictionary* headers, NSUInteger number)
+                             {
+                                 sleep(6);
+                             }];
+    NSError* e = nil;
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    NSData* data = [Loader() dataWithContentsOfURL: server.url error: &e];
+    CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - start;
+    Check(!data && NSURLErrorTimedOut == [e code], @"a server that doesn't respond times out");
+    Check(elapsed < 4.5, @"the connect deadline is kept");
+    [server stop];
+}
+
+
+/// A server that stops sending part way through is resumed after the read deadline
+static void TestReadStall(void)
+{
+    StandInServer* server = [[StandInServer alloc] initWithResponder: ^(int fd, NSDictionary* headers, NSUInteger number)
+                             {
+                                 if (number)
+                                 {
+                                     SendRest(fd, RangeStart(headers), BodySize);
+                                     return;
+                                 }
+                                 SendWhole(fd, BodySize / 2);
+                                 sleep(6);
+                             }];
+    NSError* e = nil;
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    NSData* data = [Loader() dataWithContentsOfURL: server.url error: &e];
+    CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - start;
+    Check([data isEqualToData: Body()], @"a stalled body is resumed");
+    Check(elapsed < 4.5, @"the read deadline is kept");
+    [server stop];
+}
+
+
+/// A body that keeps getting cut off is only resumed so many times
+static void TestResumeLimit(void)
+{
+    StandInServer* server = [[StandInServer alloc] initWithResponder: ^(int fd, NSDictionary* headers, NSUInteger number)
+                             {
+                                 NSUInteger from = RangeStart(headers);
+                                 if (!number)
+                                     SendWhole(fd, 1000);
+                                 else
+                                     SendRest(fd, from, from + 1000);
+                             }];
+    HTTPLoader* loader = Loader();
+    loader.maxResumes = 2;
+    NSError* e = nil;
+    NSData* data = [loader dataWithContentsOfURL: server.url error: &e];
+    Check(!data && e, @"a body that keeps dropping is an error");
+    Check(3 == [server.requests count], @"a dropped body is resumed no more than maxResumes times");
+    [server stop];
+}
+
+
+/// Loads from one host wait their turn
+static void TestPerHostLimit(void)
+{
+    __block int inFlight = 0, most = 0;
+    NSObject* lock = [[NSObject alloc] init];
+    StandInServer* server = [[StandInServer alloc] initWithResponder: ^(int fd, NSDictionary* headers, NSUInteger number)
+                             {
+                                 @synchronized(lock)
+                                 {
+                                     most = MAX(most, ++inFlight);
+                                 }
+                                 usleep(300000);
+                                 @synchronized(lock)
+                                 {
+                                     inFlight--;
+                                 }
+                                 SendWhole(fd, BodySize);
+                             }];
+    HTTPLoader* loader = Loader();
+    loader.maxConnectionsPerHost = 1;
+    dispatch_group_t group = dispatch_group_create();
+    for (int I = 0; I < 3; I++)
+        dispatch_group_async(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(void)
+                             {
+                                 [loader dataWithContentsOfURL: server.url error: NULL];
+                             });
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    Check(3 == [server.requests count] && 1 == most, @"only one load per host is in flight");
+    [server stop];
+}
+
+
+/// URLs with and without the default port are the same host
+static void TestHostKey(void)
+{
+    HTTPLoader* loader = Loader();
+    Check([[loader hostKeyForURL: [NSURL URLWithString: @"http://Example.com/a"]]
+           isEqualToString: [loader hostKeyForURL: [NSURL URLWithString: @"http://example.com:80/b"]]],
+          @"http default port is filled in");
+    Check([[loader hostKeyForURL: [NSURL URLWithString: @"https://example.com/"]] hasSuffix: @":443"],
+          @"https default port is filled in");
+    Check(![loader hostKeyForURL: [NSURL URLWithString: @"ftp://example.com/"]],
+          @"URLs that aren't HTTP have no host key");
+}
+
+
+int main(int argc, const char* argv[])
+{
+    // The server writes to connections that the loader may have given up on
+    signal(SIGPIPE, SIG_IGN);
+    @autoreleasepool
+    {
+        TestHostKey();
+        TestWhole();
+        TestResumeAfterDrop();
+        TestRestartOn200();
+        TestWrongContentRange();
+        TestConnectStall();
+        TestReadStall();
+        TestResumeLimit();
+        TestPerHostLimit();
+    }
+    return failures ? 1 : 0;
+}
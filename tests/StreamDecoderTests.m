@@ -0,0 +1,341 @@
+//
+//  StreamDecoderTests.m
+//  QC Utilities
+//
+//  Created by Randall Maas on 10/19/26.
+/*
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+/*
+ Tests and a benchmark for StreamDecoder.  Build and run from the top of the repository with:
+
+    clang -fobjc-arc -framework Foundation -lz tests/StreamDecoderTests.m src/StreamDecoder.m -o /tmp/StreamDecoderTests && /tmp/StreamDecoderTests
+
+ It prints PASS or FAIL for each check, and exits with 1 if any failed.  Then it writes a large
+ gzip file (64 MB of text unless another size, in MB, is given as the argument), and reports
+ how fast it is loaded and the peak memory used, compared with reading the whole compressed file
+ into memory first.
+ */
+
+#import <Foundation/Foundation.h>
+#import <sys/resource.h>
+#import <zlib.h>
+#import "../src/StreamDecoder.h"
+
+/// The size of the chunks that StreamDecoder's file reader hands over; see StreamDecoder.m
+#define ReadChunkSize (256*1024)
+
+
+#pragma mark Helpers
+
+/// The number of checks that failed
+static int failures = 0;
+
+/// Report a check
+static void Check(BOOL ok, NSString* name)
+{
+    printf("%s %s\n", ok ? "PASS" : "FAIL", [name UTF8String]);
+    if (!ok)
+        failures++;
+}
+
+
+/// Some text to compress; each line is different, so it compresses about as well as a log
+static NSData* Text(NSUInteger length)
+{
+    NSMutableData* text = [NSMutableData dataWithCapacity: length + 100];
+    for (NSUInteger I = 0; [text length] < length; I++)
+    {
+        char line[100];
+        int n = snprintf(line, sizeof line, "%08lu the quick brown fox %lu jumps over the lazy dog\n",
+                         (unsigned long) I, (unsigned long)(I * 2654435761u % 1000003));
+        [text appendBytes: line length: n];
+    }
+    [text setLength: length];
+    return text;
+}
+
+
+/** Compress the data as one gzip member
+    @param data   The bytes to compress
+    @param level  The zlib compression level; zero just stores the bytes
+ */
+static NSData* Gzip(NSData* data, int level)
+{
+    z_stream zs = {0};
+    deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    NSMutableData* output = [NSMutableData dataWithLength: deflateBound(&zs, [data length])];
+    zs.next_in   = (Bytef*) [data bytes];
+    zs.avail_in  = (uInt) [data length];
+    zs.next_out  = [output mutableBytes];
+    zs.avail_out = (uInt) [output length];
+    deflate(&zs, Z_FINISH);
+    [output setLength: zs.total_out];
+    deflateEnd(&zs);
+    return output;
+}
+
+
+/** Decode the data a few bytes at a time, the way it would arrive from the network
+    @param data   The bytes to decode
+    @param size   The most bytes to hand over at a time
+    @param error  Where to put the reason it couldn't be decoded
+    @returns The decoded bytes; nil on error
+ */
+static NSData* DecodeInChunks(NSData* data, NSUInteger size, NSError** error)
+{
+    StreamDecoder* decoder = [[StreamDecoder alloc] initWithContentEncoding: nil];
+    NSMutableData* output = [[NSMutableData alloc] init];
+    for (NSUInteger I = 0; I < [data length]; I += size)
+    {
+        NSData* decoded = [decoder decode: [data subdataWithRange: NSMakeRange(I, MIN(size, [data length] - I))]
+                                    error: error];
+        if (!decoded)
+            return nil;
+        [output appendData: decoded];
+    }
+    NSData* rest = [decoder finish: error];
+    if (!rest)
+        return nil;
+    [output appendData: rest];
+    return output;
+}
+
+
+/// Write the data to a file in the temporary folder, and return its path
+static NSString* TempFile(NSString* name, NSData* data)
+{
+    NSString* path = [NSTemporaryDirectory() stringByAppendingPathComponent: name];
+    [data writeToFile: path atomically: NO];
+    return path;
+}
+
+
+/// The most memory that this process has used so far, in bytes
+static double PeakMemory(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    // It is in bytes on the Mac, and in kilobytes elsewhere
+    return (double) usage.ru_maxrss;
+#else
+    return (double) usage.ru_maxrss * 1024.0;
+#endif
+}
+
+
+#pragma mark Tests
+
+/// Data that isn't compressed is passed through, even if it is shorter than the magic number
+static void TestPlain(void)
+{
+    NSError* e = nil;
+    NSData* text = [@"plain text" dataUsingEncoding: NSUTF8StringEncoding];
+    Check([[StreamDecoder decodeData: text contentEncoding: nil error: &e] isEqualToData: text], @"plain text is passed through");
+
+    for (NSString* s in @[@"", @"a", @"ab", @"abc"])
+    {
+        NSData* shortText = [s dataUsingEncoding: NSUTF8StringEncoding];
+        NSData* decoded = DecodeInChunks(shortText, 1, &e);
+        Check([decoded isEqualToData: shortText], [NSString stringWithFormat: @"%lu bytes, fewer than the magic number, are passed through", (unsigned long)[shortText length]]);
+    }
+
+    // Two bytes that look like the start of a gzip header, but end there
+    uint8_t gzipStart[] = {0x1f, 0x8b};
+    NSData* decoded = DecodeInChunks([NSData dataWithBytes: gzipStart length: sizeof gzipStart], 1, &e);
+    Check([decoded length] == sizeof gzipStart, @"the start of a gzip header, shorter than the magic number, is passed through");
+
+    // Text that starts like a zlib header is only taken as one when the encoding says so
+    NSData* zlibLike = [@"x^ looks like a zlib header" dataUsingEncoding: NSUTF8StringEncoding];
+    Check([[StreamDecoder decodeData: zlibLike contentEncoding: nil error: &e] isEqualToData: zlibLike], @"text that starts like a zlib header is passed through");
+}
+
+
+/// gzip is decoded, however the bytes are split up
+static void TestGzip(void)
+{
+    NSData* text = Text(300*1000);
+    NSData* gz = Gzip(text, Z_DEFAULT_COMPRESSION);
+    NSError* e = nil;
+    Check([[StreamDecoder decodeData: gz contentEncoding: nil error: &e] isEqualToData: text], @"gzip is decoded");
+    Check([DecodeInChunks(gz, 1, &e) isEqualToData: text], @"gzip handed over a byte at a time is decoded");
+    Check([DecodeInChunks(gz, 3, &e) isEqualToData: text], @"gzip with the magic number split across chunks is decoded");
+}
+
+
+/// Several gzip members, one after the other, are decoded as one
+static void TestMultiMember(void)
+{
+    NSData* first  = Text(100*1000);
+    NSData* second = [@"and the second member\n" dataUsingEncoding: NSUTF8StringEncoding];
+    NSData* firstGz = Gzip(first, Z_DEFAULT_COMPRESSION);
+    NSMutableData* gz = [firstGz mutableCopy];
+    [gz appendData: Gzip(second, Z_DEFAULT_COMPRESSION)];
+    NSMutableData* text = [first mutableCopy];
+    [text appendData: second];
+
+    NSError* e = nil;
+    Check([[StreamDecoder decodeData: gz contentEncoding: nil error: &e] isEqualToData: text], @"multi-member gzip is decoded");
+    Check([DecodeInChunks(gz, 7, &e) isEqualToData: text], @"multi-member gzip in small chunks is decoded");
+    // The first member ends exactly at the end of a chunk
+    Check([DecodeInChunks(gz, [firstGz length], &e) isEqualToData: text], @"a gzip member ending at the end of a chunk is decoded");
+}
+
+
+/// A gzip member that ends exactly where the file reader's first chunk does
+static void TestMemberAtReadChunk(void)
+{
+    // Stored (uncompressed) members grow a byte for each byte of text, so the text can be sized
+    // to make the member exactly one chunk long
+    NSUInteger length = ReadChunkSize - 100;
+    NSData* firstGz = nil;
+    for (int tries = 0; tries < 20; tries++)
+    {
+        firstGz = Gzip(Text(length), 0);
+        if ([firstGz length] == ReadChunkSize)
+            break;
+        length += (NSInteger) ReadChunkSize - (NSInteger)[firstGz length];
+    }
+    Check([firstGz length] == ReadChunkSize, @"made a gzip member exactly one read chunk long");
+
+    NSData* second = Text(5000);
+    NSMutableData* gz = [firstGz mutableCopy];
+    [gz appendData: Gzip(second, Z_DEFAULT_COMPRESSION)];
+    NSMutableData* text = [Text(length) mutableCopy];
+    [text appendData: second];
+
+    NSError* e = nil;
+    NSString* path = TempFile(@"StreamDecoderTests-chunk.gz", gz);
+    Check([[StreamDecoder dataWithContentsOfFile: path error: &e] isEqualToData: text], @"a file whose first gzip member ends at the end of a read chunk is loaded");
+    [[NSFileManager defaultManager] removeItemAtPath: path error: NULL];
+}
+
+
+/// A gzip stream that is cut short, or corrupt, is an error
+static void TestTruncated(void)
+{
+    NSData* text = Text(100*1000);
+    NSData* gz = Gzip(text, Z_DEFAULT_COMPRESSION);
+    NSData* cut = [gz subdataWithRange: NSMakeRange(0, [gz length] / 2)];
+
+    NSError* e = nil;
+    Check(!DecodeInChunks(cut, 1000, &e) && NSFileReadCorruptFileError == [e code], @"a truncated gzip stream is an error");
+
+    e = nil;
+    NSString* path = TempFile(@"StreamDecoderTests-cut.gz", cut);
+    NSData* data = [StreamDecoder dataWithContentsOfFile: path error: &e];
+    Check(!data && NSFileReadCorruptFileError == [e code], @"a truncated gzip file is an error");
+    Check(![StreamDecoder isReadError: e], @"a truncated gzip file is not a read error");
+    [[NSFileManager defaultManager] removeItemAtPath: path error: NULL];
+
+    NSMutableData* corrupt = [gz mutableCopy];
+    memset((uint8_t*)[corrupt mutableBytes] + 20, 0xff, 16);
+    e = nil;
+    Check(![StreamDecoder decodeData: corrupt contentEncoding: nil error: &e] && NSFileReadCorruptFileError == [e code], @"corrupt gzip is an error");
+}
+
+
+/// A file that isn't there is a read error, so that the path can be tried as a URL
+static void TestMissing(void)
+{
+    NSError* e = nil;
+    NSData* data = [StreamDecoder dataWithContentsOfFile: @"/nonexistent/StreamDecoderTests.gz" error: &e];
+    Check(!data && [StreamDecoder isReadError: e], @"a missing file is a read error");
+}
+
+
+#pragma mark Benchmark
+
+/// Write the text to a gzip file a piece at a time, so that the benchmark doesn't start out big
+static NSString* WriteBigGzip(NSUInteger megabytes, NSUInteger* textLength)
+{
+    NSString* path = [NSTemporaryDirectory() stringByAppendingPathComponent: @"StreamDecoderTests-big.gz"];
+    gzFile file = gzopen([path fileSystemRepresentation], "wb6");
+    *textLength = 0;
+    while (*textLength < megabytes * 1024 * 1024)
+    {
+        @autoreleasepool
+        {
+            NSData* piece = Text(1024 * 1024);
+            gzwrite(file, [piece bytes], (unsigned)[piece length]);
+            *textLength += [piece length];
+        }
+    }
+    gzclose(file);
+    return path;
+}
+
+
+/** Time loading the file, and the most memory used
+    @param name        What to call the way it is loaded
+    @param path        The gzip file
+    @param streamed    True to stream it through dataWithContentsOfFile:, false to read the whole
+                       compressed file into memory and then decode it
+    @param textLength  The length of the text in the file
+ */
+static void Bench(NSString* name, NSString* path, BOOL streamed, NSUInteger textLength)
+{
+    double before = PeakMemory();
+    NSDate* start = [NSDate date];
+    NSUInteger length = 0;
+    @autoreleasepool
+    {
+        NSError* e = nil;
+        NSData* data;
+        if (streamed)
+            data = [StreamDecoder dataWithContentsOfFile: path error: &e];
+        else
+            data = [StreamDecoder decodeData: [NSData dataWithContentsOfFile: path]
+                             contentEncoding: nil
+                                       error: &e];
+        length = [data length];
+    }
+    NSTimeInterval elapsed = -[start timeIntervalSinceNow];
+    unsigned long long compressed = [[[NSFileManager defaultManager] attributesOfItemAtPath: path error: NULL] fileSize];
+    Check(length == textLength, [NSString stringWithFormat: @"%@ loads the whole file", name]);
+    printf("%-22s %8.1f MB/s compressed  %8.1f MB/s decompressed  peak %7.1f MB (%+.1f MB)\n",
+           [name UTF8String], compressed / elapsed / 1e6, length / elapsed / 1e6,
+           PeakMemory() / 1e6, (PeakMemory() - before) / 1e6);
+}
+
+
+int main(int argc, const char* argv[])
+{
+    @autoreleasepool
+    {
+        TestPlain();
+        TestGzip();
+        TestMultiMember();
+        TestMemberAtReadChunk();
+        TestTruncated();
+        TestMissing();
+
+        NSUInteger megabytes = argc > 1 ? (NSUInteger) atoi(argv[1]) : 64;
+        NSUInteger textLength;
+        NSString* path = WriteBigGzip(megabytes, &textLength);
+        // The peak only ever goes up, so the streamed load goes first; its peak includes the
+        // decompressed text, which the caller keeps either way
+        Bench(@"streamed", path, YES, textLength);
+        Bench(@"whole file, then decode", path, NO, textLength);
+        [[NSFileManager defaultManager] removeItemAtPath: path error: NULL];
+    }
+    return failures ? 1 : 0;
+}